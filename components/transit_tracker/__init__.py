@@ -6,12 +6,15 @@ from esphome.components.font import Font
 from esphome.components.time import RealTimeClock
 from esphome.components import color
 from esphome.const import CONF_ID, CONF_DISPLAY_ID, CONF_TIME_ID, CONF_SHOW_UNITS
+from esphome.helpers import cpp_string_escape
 
 DEPENDENCIES = ["network"]
 AUTO_LOAD = ["json", "watchdog"]
 
 transit_tracker_ns = cg.esphome_ns.namespace("transit_tracker")
 TransitTracker = transit_tracker_ns.class_("TransitTracker", cg.PollingComponent)
+StaticRouteStyle = transit_tracker_ns.struct("StaticRouteStyle")
+StaticAbbreviation = transit_tracker_ns.struct("StaticAbbreviation")
 
 UnitDisplay = transit_tracker_ns.enum("UnitDisplay")
 UNIT_DISPLAY_VALUES = {
@@ -31,6 +34,21 @@ CONF_FEED_CODE = "feed_code"
 CONF_DEFAULT_ROUTE_COLOR = "default_route_color"
 CONF_TIME_DISPLAY = "time_display"
 CONF_LIST_MODE = "list_mode"
+CONF_FEEDS = "feeds"
+CONF_SHARE_CONNECTION = "share_connection"
+CONF_JSON_DOCUMENT_LIMIT = "json_document_limit"
+CONF_LOW_MEMORY = "low_memory"
+CONF_FRAME_CAPTURE = "frame_capture"
+CONF_FRAMES = "frames"
+CONF_BUFFER_SIZE = "buffer_size"
+
+
+def emit_static_table(entry_type, name, entries):
+    # Keys are sorted at build time so the firmware can binary search them
+    body = ",\n  ".join(entries)
+    cg.add_global(
+        cg.RawStatement(f"static constexpr {entry_type} {name}[] = {{\n  {body}\n}};")
+    )
 
 
 def validate_ws_url(value):
@@ -77,6 +95,27 @@ CONFIG_SCHEMA = cv.Schema(
                 }
             )
         ),
+        cv.Optional(CONF_LOW_MEMORY, default=False): cv.boolean,
+        cv.Optional(CONF_JSON_DOCUMENT_LIMIT): cv.All(
+            cv.validate_bytes, cv.int_range(min=1024)
+        ),
+        cv.Optional(CONF_FRAME_CAPTURE): cv.Schema(
+            {
+                cv.Optional(CONF_FRAMES, default=8): cv.int_range(min=1, max=64),
+                cv.Optional(CONF_BUFFER_SIZE, default="128kB"): cv.All(
+                    cv.validate_bytes, cv.int_range(min=1024)
+                ),
+            }
+        ),
+        cv.Optional(CONF_SHARE_CONNECTION, default=False): cv.boolean,
+        cv.Optional(CONF_FEEDS): cv.ensure_list(
+            cv.Schema(
+                {
+                    cv.Required(CONF_BASE_URL): validate_ws_url,
+                    cv.Optional(CONF_FEED_CODE, default=""): cv.string,
+                }
+            )
+        ),
     }
 ).extend(cv.COMPONENT_SCHEMA)
 
@@ -100,20 +139,56 @@ async def to_code(config):
         cg.add(var.set_config_url(config[CONF_CONFIG_URL]))
 
     cg.add(var.set_feed_code(config[CONF_FEED_CODE]))
+    cg.add(var.set_share_connection(config[CONF_SHARE_CONNECTION]))
+
+    if CONF_FEEDS in config:
+        for feed in config[CONF_FEEDS]:
+            cg.add(var.add_feed_source(feed[CONF_BASE_URL], feed[CONF_FEED_CODE]))
 
     display_departure_times = config[CONF_TIME_DISPLAY] == "departure"
     cg.add(var.set_display_departure_times(display_departure_times))
 
     cg.add(var.set_list_mode(config[CONF_LIST_MODE]))
 
+    if config[CONF_LOW_MEMORY]:
+        cg.add_define("USE_TRANSIT_TRACKER_LOW_MEMORY")
+
+    json_document_limit = config.get(
+        CONF_JSON_DOCUMENT_LIMIT, 12 * 1024 if config[CONF_LOW_MEMORY] else 48 * 1024
+    )
+    cg.add(var.set_json_document_limit(json_document_limit))
+
+    if CONF_FRAME_CAPTURE in config:
+        frame_capture = config[CONF_FRAME_CAPTURE]
+        cg.add(
+            var.set_frame_capture(
+                frame_capture[CONF_FRAMES], frame_capture[CONF_BUFFER_SIZE]
+            )
+        )
+
     cg.add(var.set_limit(config[CONF_LIMIT]))
     cg.add(var.set_display_limit(config[CONF_DISPLAY_LIMIT]))
 
-    cg.add(var.set_unit_display(config[CONF_SHOW_UNITS]))
+    # A template argument rather than a runtime value, so the formatter for
+    # the chosen units is picked at compile time
+    cg.add(var.set_unit_display.template(config[CONF_SHOW_UNITS])())
 
     if CONF_ABBREVIATIONS in config:
-        for abbreviation in config[CONF_ABBREVIATIONS]:
-            cg.add(var.add_abbreviation(abbreviation["from"], abbreviation["to"]))
+        # Later entries win, as they did when each was added to a map
+        abbreviations = {
+            abbreviation["from"]: abbreviation["to"]
+            for abbreviation in config[CONF_ABBREVIATIONS]
+        }
+        table = f"{config[CONF_ID]}_abbreviations"
+        entries = [
+            f"{{{cpp_string_escape(source)}, {len(source.encode())}, "
+            f"{cpp_string_escape(target)}, {len(target.encode())}}}"
+            for source, target in sorted(
+                abbreviations.items(), key=lambda item: item[0].encode()
+            )
+        ]
+        emit_static_table(StaticAbbreviation, table, entries)
+        cg.add(var.set_static_abbreviations(cg.RawExpression(table), len(entries)))
 
     if CONF_DEFAULT_ROUTE_COLOR in config:
         cg.add(
@@ -123,9 +198,19 @@ async def to_code(config):
         )
 
     if CONF_STYLES in config:
-        for style in config[CONF_STYLES]:
+        styles = {style["route_id"]: style for style in config[CONF_STYLES]}
+        table = f"{config[CONF_ID]}_route_styles"
+        entries = []
+        for route_id, style in sorted(
+            styles.items(), key=lambda item: item[0].encode()
+        ):
             color_struct = await cg.get_variable(style["color"])
-            cg.add(var.add_route_style(style["route_id"], style["name"], color_struct))
+            entries.append(
+                f"{{{cpp_string_escape(route_id)}, "
+                f"{cpp_string_escape(style['name'])}, &{color_struct}}}"
+            )
+        emit_static_table(StaticRouteStyle, table, entries)
+        cg.add(var.set_static_route_styles(cg.RawExpression(table), len(entries)))
 
     await cg.register_component(var, config)
 
@@ -0,0 +1,194 @@
+#include "arena.h"
+
+#include <string.h>
+#include <algorithm>
+#include <utility>
+
+extern "C" {
+  #include "esp_heap_caps.h"
+}
+
+namespace esphome {
+namespace transit_tracker {
+
+static void *bump(uint8_t *base, size_t capacity, size_t &used, size_t size, size_t align) {
+  uintptr_t start = reinterpret_cast<uintptr_t>(base) + used;
+  uintptr_t aligned = (start + align - 1) & ~static_cast<uintptr_t>(align - 1);
+  size_t offset = aligned - reinterpret_cast<uintptr_t>(base);
+  if (offset > capacity || size > capacity - offset) {
+    return nullptr;
+  }
+
+  used = offset + size;
+  return base + offset;
+}
+
+Arena::~Arena() {
+  this->reset();
+  if (this->base_ != nullptr) {
+    heap_caps_free(this->base_);
+  }
+}
+
+bool Arena::init(size_t capacity, uint32_t caps, AllocCategory category, size_t grow_size) {
+  this->reset();
+  if (this->base_ != nullptr) {
+    heap_caps_free(this->base_);
+    this->base_ = nullptr;
+    this->capacity_ = 0;
+  }
+
+  this->caps_ = caps;
+  this->category_ = category;
+  this->grow_size_ = grow_size;
+
+  this->base_ = static_cast<uint8_t *>(heap_caps_malloc(capacity, caps));
+  if (this->base_ == nullptr) {
+    return false;
+  }
+
+  MemoryTelemetry::record_alloc(category);
+  this->capacity_ = capacity;
+  return true;
+}
+
+bool Arena::reserve(size_t capacity, size_t limit) {
+  if (capacity <= this->capacity_) {
+    return this->base_ != nullptr;
+  }
+
+  size_t new_capacity = std::max(capacity, this->capacity_ * 2);
+  if (limit != 0) {
+    new_capacity = std::max(capacity, std::min(new_capacity, limit));
+  }
+
+  // Freeing first keeps the peak down; the old size is retried on failure
+  size_t old_capacity = this->capacity_;
+  this->reset();
+  if (this->base_ != nullptr) {
+    heap_caps_free(this->base_);
+    this->base_ = nullptr;
+    this->capacity_ = 0;
+  }
+
+  this->base_ = static_cast<uint8_t *>(heap_caps_malloc(new_capacity, this->caps_));
+  if (this->base_ == nullptr) {
+    if (old_capacity > 0) {
+      this->base_ = static_cast<uint8_t *>(heap_caps_malloc(old_capacity, this->caps_));
+      this->capacity_ = this->base_ != nullptr ? old_capacity : 0;
+    }
+    return false;
+  }
+
+  MemoryTelemetry::record_alloc(this->category_);
+  this->capacity_ = new_capacity;
+  return true;
+}
+
+void Arena::swap(Arena &other) {
+  std::swap(this->base_, other.base_);
+  std::swap(this->last_, other.last_);
+  std::swap(this->capacity_, other.capacity_);
+  std::swap(this->used_, other.used_);
+  std::swap(this->high_water_mark_, other.high_water_mark_);
+  std::swap(this->caps_, other.caps_);
+  std::swap(this->category_, other.category_);
+  std::swap(this->grow_size_, other.grow_size_);
+  std::swap(this->overflow_, other.overflow_);
+  std::swap(this->overflow_used_, other.overflow_used_);
+}
+
+void Arena::reset() {
+  while (this->overflow_ != nullptr) {
+    OverflowBlock *next = this->overflow_->next;
+    heap_caps_free(this->overflow_);
+    this->overflow_ = next;
+  }
+
+  this->overflow_used_ = 0;
+  this->used_ = 0;
+  this->last_ = nullptr;
+}
+
+void *Arena::allocate(size_t size, size_t align) {
+  if (this->base_ == nullptr) {
+    return nullptr;
+  }
+
+  void *ptr = nullptr;
+  if (this->overflow_ == nullptr) {
+    ptr = bump(this->base_, this->capacity_, this->used_, size, align);
+  }
+
+  if (ptr == nullptr && this->grow_size_ > 0) {
+    ptr = this->allocate_overflow_(size, align);
+  }
+
+  if (ptr != nullptr) {
+    this->last_ = static_cast<uint8_t *>(ptr);
+    this->update_high_water_mark_();
+  }
+
+  return ptr;
+}
+
+void *Arena::allocate_overflow_(size_t size, size_t align) {
+  if (this->overflow_ != nullptr) {
+    size_t before = this->overflow_->used;
+    void *ptr = bump(this->overflow_->data(), this->overflow_->capacity, this->overflow_->used, size, align);
+    if (ptr != nullptr) {
+      this->overflow_used_ += this->overflow_->used - before;
+      return ptr;
+    }
+  }
+
+  size_t capacity = std::max(this->grow_size_, size + align);
+  auto *block = static_cast<OverflowBlock *>(heap_caps_malloc(sizeof(OverflowBlock) + capacity, this->caps_));
+  if (block == nullptr) {
+    return nullptr;
+  }
+
+  MemoryTelemetry::record_alloc(this->category_);
+  block->next = this->overflow_;
+  block->capacity = capacity;
+  block->used = 0;
+  this->overflow_ = block;
+
+  void *ptr = bump(block->data(), block->capacity, block->used, size, align);
+  this->overflow_used_ += block->used;
+  return ptr;
+}
+
+char *Arena::copy_string(const char *str, size_t length) {
+  char *copy = static_cast<char *>(this->allocate(length + 1, 1));
+  if (copy != nullptr) {
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+  }
+  return copy;
+}
+
+void *Arena::resize_last(void *ptr, size_t new_size) {
+  // Only the primary block supports in-place resizing
+  if (ptr == nullptr || ptr != this->last_ || this->overflow_ != nullptr) {
+    return nullptr;
+  }
+
+  size_t offset = this->last_ - this->base_;
+  if (new_size > this->capacity_ - offset) {
+    return nullptr;
+  }
+
+  this->used_ = offset + new_size;
+  this->update_high_water_mark_();
+  return ptr;
+}
+
+void Arena::update_high_water_mark_() {
+  if (this->used() > this->high_water_mark_) {
+    this->high_water_mark_ = this->used();
+  }
+}
+
+}  // namespace transit_tracker
+}  // namespace esphome
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "memory_telemetry.h"
+
+namespace esphome {
+namespace transit_tracker {
+
+// A bump allocator. The primary block is allocated once and handed out
+// linearly; individual allocations are never freed, the whole arena is
+// recycled with reset(). If a grow size is set, allocations that do not
+// fit spill into overflow blocks, which reset() releases.
+class Arena {
+  public:
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    ~Arena();
+
+    bool init(size_t capacity, uint32_t caps, AllocCategory category, size_t grow_size = 0);
+    void swap(Arena &other);
+    // Ensures the primary block holds at least `capacity` bytes, growing it
+    // geometrically (but never past `limit`, if set). Resets the arena when
+    // it grows; on failure the previous block is kept if possible.
+    bool reserve(size_t capacity, size_t limit = 0);
+
+    void *allocate(size_t size, size_t align = alignof(max_align_t));
+    // Copies `length` bytes of `str` and NUL-terminates the copy.
+    char *copy_string(const char *str, size_t length);
+    // Grows or shrinks the most recent allocation in place. Returns nullptr
+    // if `ptr` is not the most recent allocation or the block is too small.
+    void *resize_last(void *ptr, size_t new_size);
+    void reset();
+
+    bool is_initialized() const { return base_ != nullptr; }
+    size_t capacity() const { return capacity_; }
+    size_t used() const { return used_ + overflow_used_; }
+    size_t high_water_mark() const { return high_water_mark_; }
+    // Restarts high-water tracking from the current usage
+    void reset_high_water_mark() { high_water_mark_ = used(); }
+
+  protected:
+    struct OverflowBlock {
+      OverflowBlock *next;
+      size_t capacity;
+      size_t used;
+      uint8_t *data() { return reinterpret_cast<uint8_t *>(this + 1); }
+    };
+
+    void *allocate_overflow_(size_t size, size_t align);
+    void update_high_water_mark_();
+
+    uint8_t *base_ = nullptr;
+    uint8_t *last_ = nullptr;
+    size_t capacity_ = 0;
+    size_t used_ = 0;
+    size_t high_water_mark_ = 0;
+
+    uint32_t caps_ = 0;
+    AllocCategory category_ = ALLOC_CATEGORY_PARSE;
+    size_t grow_size_ = 0;
+    OverflowBlock *overflow_ = nullptr;
+    size_t overflow_used_ = 0;
+};
+
+// Allocator adapter so ArduinoJson documents can draw their pool from an
+// Arena. Deallocation is a no-op; memory is reclaimed by Arena::reset().
+class ArenaAllocator {
+  public:
+    ArenaAllocator() = default;
+    explicit ArenaAllocator(Arena *arena) : arena_(arena) {}
+
+    void *allocate(size_t size) { return arena_ != nullptr ? arena_->allocate(size) : nullptr; }
+    void deallocate(void *) {}
+    void *reallocate(void *ptr, size_t new_size) { return arena_ != nullptr ? arena_->resize_last(ptr, new_size) : nullptr; }
+
+  protected:
+    Arena *arena_ = nullptr;
+};
+
+}  // namespace transit_tracker
+}  // namespace esphome
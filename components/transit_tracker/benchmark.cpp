@@ -0,0 +1,255 @@
+#include "transit_tracker.h"
+
+#include "esphome/core/application.h"
+#include "esphome/core/log.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <map>
+#include <cstdio>
+
+#include "Arduino.h"
+
+extern "C" {
+  #include "esp_heap_caps.h"
+  #include "esp_idf_version.h"
+}
+
+namespace esphome {
+namespace transit_tracker {
+
+static const char *TAG = "transit_tracker.benchmark";
+
+struct BenchmarkCase {
+  const char *sweep;
+  int trips;
+  int stops;
+  int headsign_length;
+  int abbreviations;
+};
+
+// Each sweep varies one dimension from a modest baseline
+static const BenchmarkCase BENCHMARK_CASES[] = {
+  {"trips", 10, 1, 24, 0},
+  {"trips", 25, 1, 24, 0},
+  {"trips", 50, 1, 24, 0},
+  {"trips", 100, 1, 24, 0},
+  {"trips", 200, 1, 24, 0},
+  {"trips", 400, 1, 24, 0},
+  {"stops", 50, 4, 24, 0},
+  {"stops", 50, 16, 24, 0},
+  {"stops", 50, 64, 24, 0},
+  {"headsign", 50, 1, 8, 0},
+  {"headsign", 50, 1, 64, 0},
+  {"headsign", 50, 1, 160, 0},
+  {"abbreviations", 50, 1, 24, 10},
+  {"abbreviations", 50, 1, 24, 50},
+  {"abbreviations", 50, 1, 24, 200},
+};
+
+// Route styles loaded at runtime, by count
+static const int STYLE_BENCHMARK_SIZES[] = {10, 100, 1000};
+static const int STYLE_BENCHMARK_LOOKUPS = 2000;
+
+// Older ESP-IDF releases only track the minimum free heap since boot, which
+// says nothing about a single case
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+#define TRANSIT_TRACKER_HEAP_LOCAL_MINIMUM
+#endif
+
+static void append_format(std::string &out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static void append_format(std::string &out, const char *format, ...) {
+  char buffer[96];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (length > 0) {
+    out.append(buffer, std::min<size_t>(length, sizeof(buffer) - 1));
+  }
+}
+
+// Headsigns are built from the words "Word<n>" so the synthetic
+// abbreviations ("Word<n>" -> "W<n>") have something to match.
+static void append_headsign(std::string &out, int length, int trip) {
+  size_t start = out.size();
+  for (int word = trip; out.size() - start < static_cast<size_t>(length); word++) {
+    append_format(out, "Word%d ", word % 256);
+  }
+  out.resize(start + length);
+}
+
+static void build_schedule_frame(std::string &frame, const BenchmarkCase &bench, uint32_t subscription_id,
+                                 time_t now) {
+  frame.clear();
+  append_format(frame, "{\"event\":\"schedule\",\"data\":{\"subscriptionId\":%u,\"trips\":[", subscription_id);
+  for (int i = 0; i < bench.trips; i++) {
+    if (i > 0) {
+      frame.push_back(',');
+    }
+    append_format(frame, "{\"stopId\":\"bench_%d\",\"routeId\":\"route_%d\",\"routeName\":\"%d\",\"headsign\":\"",
+                  i % bench.stops, i % 12, i % 12);
+    append_headsign(frame, bench.headsign_length, i);
+    append_format(frame, "\",\"arrivalTime\":%ld,\"departureTime\":%ld,\"isRealtime\":%s}",
+                  static_cast<long>(now + 60 * (i + 1)), static_cast<long>(now + 60 * (i + 1) + 30),
+                  i % 2 == 0 ? "true" : "false");
+  }
+  frame.append("]}}");
+}
+
+// Times building and querying the runtime route style table against a
+// std::map, which it replaced; half the lookups hit and half miss
+static void benchmark_route_styles() {
+  for (int styles : STYLE_BENCHMARK_SIZES) {
+    App.feed_wdt();
+
+    std::vector<std::string> keys;
+    keys.reserve(2 * styles);
+    for (int i = 0; i < 2 * styles; i++) {
+      keys.push_back("route_" + std::to_string(i));
+    }
+    const std::string name = "Name";
+
+    uint32_t start = micros();
+    RouteStyleTable table;
+    table.reserve(styles);
+    for (int i = 0; i < styles; i++) {
+      table.insert(keys[i].data(), keys[i].size(), name.data(), name.size(), Color(i));
+    }
+    const uint32_t build_us = micros() - start;
+
+    start = micros();
+    std::map<std::string, std::pair<std::string, Color>, std::less<>> map;
+    for (int i = 0; i < styles; i++) {
+      map[keys[i]] = {name, Color(i)};
+    }
+    const uint32_t map_build_us = micros() - start;
+
+    int found = 0;
+    const char *style_name;
+    Color style_color;
+    start = micros();
+    for (int i = 0; i < STYLE_BENCHMARK_LOOKUPS; i++) {
+      const std::string &key = keys[i % keys.size()];
+      found += table.find(key.data(), key.size(), &style_name, &style_color);
+    }
+    const uint32_t lookup_us = micros() - start;
+
+    int map_found = 0;
+    start = micros();
+    for (int i = 0; i < STYLE_BENCHMARK_LOOKUPS; i++) {
+      map_found += map.find(keys[i % keys.size()].c_str()) != map.end();
+    }
+    const uint32_t map_lookup_us = micros() - start;
+
+    ESP_LOGI(TAG,
+             "BENCH {\"sweep\":\"route_styles\",\"styles\":%d,\"lookups\":%d,\"build_us\":%u,"
+             "\"lookup_ns\":%u,\"table_bytes\":%u,\"map_build_us\":%u,\"map_lookup_ns\":%u,\"ok\":%s}",
+             styles, STYLE_BENCHMARK_LOOKUPS, build_us, lookup_us * 1000 / STYLE_BENCHMARK_LOOKUPS,
+             table.memory_usage(), map_build_us, map_lookup_us * 1000 / STYLE_BENCHMARK_LOOKUPS,
+             found == map_found ? "true" : "false");
+  }
+}
+
+void TransitTracker::run_benchmark() {
+  if (this->sources_.empty()) {
+    ESP_LOGE(TAG, "A feed source is needed to run the benchmark");
+    return;
+  }
+
+  ESPTime now = this->rtc_->now();
+  if (!now.is_valid()) {
+    ESP_LOGE(TAG, "The benchmark needs a valid time");
+    return;
+  }
+
+  FeedSource &source = *this->sources_[0];
+  FeedConnection &connection = *source.connection;
+
+  // Keep live traffic and flash writes out of the measurements
+  this->close();
+  this->benchmarking_ = true;
+
+  std::map<std::string, std::string> abbreviations;
+  std::vector<std::string> stop_ids;
+  abbreviations.swap(this->abbreviations_);
+  const bool abbreviations_overridden = this->abbreviations_overridden_;
+  this->abbreviations_overridden_ = true;
+  stop_ids.swap(this->stop_ids_);
+  const int current_stop_index = this->current_stop_index_;
+  const int total_subpages = this->total_subpages_for_current_stop_;
+  this->current_stop_index_ = 0;
+  this->total_subpages_for_current_stop_ = 1;
+
+  ESP_LOGI(TAG, "Running %u benchmark cases", sizeof(BENCHMARK_CASES) / sizeof(BENCHMARK_CASES[0]));
+
+  std::string frame;
+  for (const BenchmarkCase &bench : BENCHMARK_CASES) {
+    App.feed_wdt();
+
+    this->abbreviations_.clear();
+    for (int i = 0; i < bench.abbreviations; i++) {
+      this->abbreviations_["Word" + std::to_string(i)] = "W" + std::to_string(i);
+    }
+    this->stop_ids_.clear();
+    for (int i = 0; i < bench.stops; i++) {
+      this->stop_ids_.push_back("bench_" + std::to_string(i));
+    }
+    this->schedule_state_.set_stops(this->stop_ids_, this->trips_per_stop_());
+
+    build_schedule_frame(frame, bench, source.subscription_id, now.timestamp);
+    const size_t frame_bytes = frame.size();
+    FeedConnection::parse_arena().reset_high_water_mark();
+#ifdef TRANSIT_TRACKER_HEAP_LOCAL_MINIMUM
+    heap_caps_monitor_local_minimum_free_size_start();
+#endif
+    const size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+
+    uint32_t start = micros();
+    connection.dispatch(&frame[0], frame.size());
+    uint32_t parse_us = micros() - start;
+
+    const bool parsed = !connection.last_parse_failed;
+    const size_t trip_bytes = this->schedule_state_.generation_bytes();
+
+    const RenderStats &render = this->probe_render_();
+
+    // Deepest the internal heap dipped below its starting point while the
+    // case parsed and rendered; -1 where the framework cannot tell
+    int heap_peak_bytes = -1;
+#ifdef TRANSIT_TRACKER_HEAP_LOCAL_MINIMUM
+    heap_peak_bytes = static_cast<int>(heap_before - heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+    heap_caps_monitor_local_minimum_free_size_stop();
+#else
+    (void) heap_before;
+#endif
+
+    // One JSON object per line, prefixed so results can be grepped out of
+    // the log and compared release to release
+    ESP_LOGI(TAG,
+             "BENCH {\"sweep\":\"%s\",\"trips\":%d,\"stops\":%d,\"headsign\":%d,\"abbreviations\":%d,"
+             "\"frame_bytes\":%u,\"doc_bytes\":%u,\"parse_peak_bytes\":%u,\"trip_bytes\":%u,"
+             "\"heap_peak_bytes\":%d,\"parse_us\":%u,\"render_us\":%u,\"pixels\":%u,\"ok\":%s}",
+             bench.sweep, bench.trips, bench.stops, bench.headsign_length, bench.abbreviations, frame_bytes,
+             connection.last_document_bytes, FeedConnection::parse_arena().high_water_mark(), trip_bytes,
+             heap_peak_bytes, parse_us, render.duration_us, render.pixels, parsed ? "true" : "false");
+  }
+
+  benchmark_route_styles();
+
+  abbreviations.swap(this->abbreviations_);
+  this->abbreviations_overridden_ = abbreviations_overridden;
+  stop_ids.swap(this->stop_ids_);
+  this->current_stop_index_ = current_stop_index;
+  this->total_subpages_for_current_stop_ = total_subpages;
+  this->render_pending_since_us_ = 0;
+  this->benchmarking_ = false;
+  this->status_clear_error();
+
+  // Drop the synthetic trips and resubscribe for live data
+  this->schedule_state_.set_stops(this->stop_ids_, this->trips_per_stop_());
+  this->connect_ws_();
+}
+
+}  // namespace transit_tracker
+}  // namespace esphome
@@ -0,0 +1,140 @@
+#include "config_fetcher.h"
+#include "memory_telemetry.h"
+
+#include "esphome/core/log.h"
+
+#include <ArduinoJson.h>
+#include <HTTPClient.h>
+
+namespace esphome {
+namespace transit_tracker {
+
+static const char *TAG = "transit_tracker.config";
+
+static const uint32_t FETCH_TASK_STACK_SIZE = 8192;
+// The filtered document only holds this device's subtree, whatever the
+// size of the fleet config around it. It starts small and doubles, with the
+// request repeated, each time the subtree does not fit, up to a fixed cap.
+static const size_t MIN_FILTERED_JSON_CAPACITY = 4 * 1024;
+static const size_t MAX_FILTERED_JSON_CAPACITY = 32 * 1024;
+
+bool ConfigFetcher::start(const std::string &url, uint32_t timeout_ms, const std::string &filter_key,
+                          const std::string &etag, const std::string &last_modified) {
+  if (this->is_busy()) {
+    ESP_LOGW(TAG, "Config fetch already in progress");
+    return false;
+  }
+
+  this->url_ = url;
+  this->timeout_ms_ = timeout_ms;
+  this->filter_key_ = filter_key;
+  this->etag_ = etag;
+  this->last_modified_ = last_modified;
+  this->result_ = ConfigFetchResult{};
+  this->state_.store(STATE_RUNNING, std::memory_order_release);
+
+  if (xTaskCreate(ConfigFetcher::fetch_task_, "tt_config", FETCH_TASK_STACK_SIZE, this, 1, nullptr) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to start config fetch task");
+    this->state_.store(STATE_IDLE, std::memory_order_release);
+    return false;
+  }
+
+  return true;
+}
+
+bool ConfigFetcher::poll(ConfigFetchResult &result) {
+  if (this->state_.load(std::memory_order_acquire) != STATE_DONE) {
+    return false;
+  }
+
+  result = std::move(this->result_);
+  this->state_.store(STATE_IDLE, std::memory_order_release);
+  return true;
+}
+
+void ConfigFetcher::fetch_task_(void *arg) {
+  auto *fetcher = static_cast<ConfigFetcher *>(arg);
+  fetcher->fetch_();
+  fetcher->state_.store(STATE_DONE, std::memory_order_release);
+  vTaskDelete(nullptr);
+}
+
+void ConfigFetcher::fetch_() {
+  size_t capacity = MIN_FILTERED_JSON_CAPACITY;
+  while (!this->fetch_once_(capacity) && capacity < MAX_FILTERED_JSON_CAPACITY) {
+    capacity *= 2;
+  }
+}
+
+bool ConfigFetcher::fetch_once_(size_t capacity) {
+  this->result_ = ConfigFetchResult{};
+
+  HTTPClient http;
+  // HTTP/1.0 rules out chunked transfer encoding, so the raw stream can be
+  // handed straight to the JSON parser
+  http.useHTTP10(!this->filter_key_.empty());
+  http.setConnectTimeout(this->timeout_ms_);
+  http.setTimeout(this->timeout_ms_);
+
+  if (!http.begin(this->url_.c_str())) {
+    this->result_.status_code = HTTPC_ERROR_CONNECTION_REFUSED;
+    return true;
+  }
+
+  if (!this->etag_.empty()) {
+    http.addHeader("If-None-Match", this->etag_.c_str());
+  }
+  if (!this->last_modified_.empty()) {
+    http.addHeader("If-Modified-Since", this->last_modified_.c_str());
+  }
+
+  static const char *RESPONSE_HEADERS[] = {"ETag", "Last-Modified"};
+  http.collectHeaders(RESPONSE_HEADERS, 2);
+
+  bool complete = true;
+  this->result_.status_code = http.GET();
+  if (this->result_.status_code == HTTP_CODE_OK) {
+    this->result_.etag = http.header("ETag").c_str();
+    this->result_.last_modified = http.header("Last-Modified").c_str();
+    if (this->filter_key_.empty()) {
+      this->result_.body = http.getString().c_str();
+    } else {
+      complete = this->read_filtered_body_(http.getStream(), capacity);
+    }
+  }
+
+  http.end();
+  return complete;
+}
+
+bool ConfigFetcher::read_filtered_body_(Stream &stream, size_t capacity) {
+  StaticJsonDocument<128> filter;
+  filter[this->filter_key_] = true;
+
+  AllocScope alloc_scope(ALLOC_CATEGORY_PARSE);
+  BasicJsonDocument<CountingAllocator> doc(capacity);
+  if (doc.capacity() == 0) {
+    this->result_.status_code = CONFIG_FETCH_ERROR_PARSE;
+    this->result_.error = "No memory for a " + std::to_string(capacity) + " byte config JSON document";
+    return true;
+  }
+
+  DeserializationError err = deserializeJson(doc, stream, DeserializationOption::Filter(filter));
+  if (err) {
+    this->result_.status_code = CONFIG_FETCH_ERROR_PARSE;
+    if (err == DeserializationError::NoMemory && capacity < MAX_FILTERED_JSON_CAPACITY) {
+      return false;
+    }
+    this->result_.error = "Failed to parse config JSON (" + std::to_string(capacity) + " byte document): " + err.c_str();
+    return true;
+  }
+
+  JsonVariant subtree = doc[this->filter_key_];
+  if (!subtree.isNull()) {
+    serializeJson(subtree, this->result_.body);
+  }
+  return true;
+}
+
+}  // namespace transit_tracker
+}  // namespace esphome
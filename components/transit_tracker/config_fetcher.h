@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include <Stream.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+namespace esphome {
+namespace transit_tracker {
+
+// Status code reported when a filtered response body could not be parsed
+static const int CONFIG_FETCH_ERROR_PARSE = -100;
+
+struct ConfigFetchResult {
+  int status_code = 0;
+  // With a filter key set, only the serialized subtree under that key;
+  // empty if the key was not present.
+  std::string body;
+  // Cache validators from the response, sent back on the next request
+  std::string etag;
+  std::string last_modified;
+  // Why the body could not be read, for the owner to log; the fetch task
+  // does not log itself
+  std::string error;
+};
+
+// Performs the remote config HTTP GET on a background FreeRTOS task so the
+// main loop (and first paint) never blocks on a slow config server. The
+// owner starts a fetch and then polls for the result from loop().
+class ConfigFetcher {
+  public:
+    // If `etag` or `last_modified` are set, the request is conditional and
+    // an unchanged config comes back as 304 Not Modified with no body. If
+    // `filter_key` is set, only that top-level member of the response is
+    // materialised, parsed straight from the HTTP stream; the rest of the
+    // document is skipped. Nothing is changed if a fetch is in progress.
+    bool start(const std::string &url, uint32_t timeout_ms, const std::string &filter_key = "",
+               const std::string &etag = "", const std::string &last_modified = "");
+    bool is_busy() const { return state_.load(std::memory_order_acquire) != STATE_IDLE; }
+    // Returns true exactly once per fetch, when the result is ready.
+    bool poll(ConfigFetchResult &result);
+
+  protected:
+    enum State : uint8_t {
+      STATE_IDLE,
+      STATE_RUNNING,
+      STATE_DONE
+    };
+
+    static void fetch_task_(void *arg);
+    void fetch_();
+    // These return false if the filtered subtree did not fit in a
+    // `capacity` byte document and the fetch should be repeated with more
+    bool fetch_once_(size_t capacity);
+    bool read_filtered_body_(Stream &stream, size_t capacity);
+
+    std::atomic<uint8_t> state_{STATE_IDLE};
+    std::string url_;
+    uint32_t timeout_ms_ = 0;
+    std::string etag_;
+    std::string last_modified_;
+    std::string filter_key_;
+    ConfigFetchResult result_;
+};
+
+}  // namespace transit_tracker
+}  // namespace esphome
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+namespace esphome {
+namespace transit_tracker {
+
+enum UnitDisplay : uint8_t {
+  UNIT_DISPLAY_LONG,
+  UNIT_DISPLAY_SHORT,
+  UNIT_DISPLAY_NONE
+};
+
+// Large enough for any duration format_duration() produces
+static const size_t DURATION_BUFFER_SIZE = 16;
+
+// Formats a time until departure, in seconds, for display. Returns either a
+// constant string or `buffer`, which must hold DURATION_BUFFER_SIZE bytes.
+typedef const char *(*DurationFormatter)(int seconds, char *buffer);
+
+template<UnitDisplay U> struct UnitSuffix;
+template<> struct UnitSuffix<UNIT_DISPLAY_LONG> {
+  static constexpr const char *MINUTES = "min";
+};
+template<> struct UnitSuffix<UNIT_DISPLAY_SHORT> {
+  static constexpr const char *MINUTES = "m";
+};
+template<> struct UnitSuffix<UNIT_DISPLAY_NONE> {
+  static constexpr const char *MINUTES = "";
+};
+
+// Labels for every whole number of minutes shown before durations switch to
+// hours, e.g. "0min" to "59min"
+struct MinuteLabels {
+  static const int COUNT = 60;
+  char text[COUNT][6];
+};
+
+template<UnitDisplay U> constexpr MinuteLabels make_minute_labels() {
+  MinuteLabels labels{};
+  for (int minutes = 0; minutes < MinuteLabels::COUNT; minutes++) {
+    char *out = labels.text[minutes];
+    if (minutes >= 10) {
+      *out++ = '0' + minutes / 10;
+    }
+    *out++ = '0' + minutes % 10;
+    for (const char *suffix = UnitSuffix<U>::MINUTES; *suffix != '\0'; suffix++) {
+      *out++ = *suffix;
+    }
+  }
+  return labels;
+}
+
+// Built at compile time, one table per unit display that is used
+template<UnitDisplay U> struct MinuteTable {
+  static constexpr MinuteLabels LABELS = make_minute_labels<U>();
+};
+
+template<UnitDisplay U> const char *format_duration(int seconds, char *buffer) {
+  if (seconds < 30) {
+    return "Now";
+  }
+
+  const int minutes = seconds / 60;
+  if (minutes < MinuteLabels::COUNT) {
+    return MinuteTable<U>::LABELS.text[minutes];
+  }
+
+  if (U == UNIT_DISPLAY_NONE) {
+    snprintf(buffer, DURATION_BUFFER_SIZE, "%d:%02d", minutes / 60, minutes % 60);
+  } else {
+    snprintf(buffer, DURATION_BUFFER_SIZE, "%dh%dm", minutes / 60, minutes % 60);
+  }
+  return buffer;
+}
+
+}  // namespace transit_tracker
+}  // namespace esphome
@@ -0,0 +1,192 @@
+#include "feed_connection.h"
+
+#include "esphome/core/log.h"
+
+#include <string.h>
+
+#include "Arduino.h"
+
+namespace esphome {
+namespace transit_tracker {
+
+static const char *TAG = "transit_tracker.feed";
+
+size_t FeedConnection::document_limit_ = 0;
+size_t FeedConnection::document_high_water_ = 0;
+
+// Filter applied to every inbound frame: only the fields the trackers read
+// are kept, which bounds the document regardless of what else the server
+// adds to a frame.
+static const JsonDocument &message_filter() {
+  static StaticJsonDocument<384> filter;
+  if (filter.isNull()) {
+    filter["event"] = true;
+    JsonObject data = filter.createNestedObject("data");
+    data["subscriptionId"] = true;
+    JsonObject trip = data.createNestedArray("trips").createNestedObject();
+    for (const char *field : {"stopId", "routeId", "routeName", "routeColor", "headsign", "arrivalTime",
+                              "departureTime", "isRealtime"}) {
+      trip[field] = true;
+    }
+  }
+  return filter;
+}
+
+// Upper bound on the pool a frame needs when parsed in place. Strings stay
+// in the input buffer, so the pool holds one slot per object member and
+// array element; the first of each follows a '{' or '[' and the rest a
+// ',', so counting those outside strings bounds the slot count.
+static size_t estimate_document_capacity(const char *json, size_t length) {
+  size_t slots = 1;
+  bool in_string = false;
+  for (size_t i = 0; i < length; i++) {
+    char c = json[i];
+    if (in_string) {
+      if (c == '\\') {
+        i++;
+      } else if (c == '"') {
+        in_string = false;
+      }
+    } else if (c == '"') {
+      in_string = true;
+    } else if (c == ',' || c == '{' || c == '[') {
+      slots++;
+    }
+  }
+  return slots * JSON_OBJECT_SIZE(1);
+}
+
+FeedConnection *FeedConnection::get(const std::string &base_url, bool shared) {
+  static std::vector<std::unique_ptr<FeedConnection>> connections;
+
+  if (shared) {
+    for (auto &connection : connections) {
+      if (connection->shared_ && connection->base_url_ == base_url) {
+        return connection.get();
+      }
+    }
+  }
+
+  connections.emplace_back(new FeedConnection(base_url));
+  connections.back()->shared_ = shared;
+  return connections.back().get();
+}
+
+Arena &FeedConnection::parse_arena() {
+  static Arena arena;
+  return arena;
+}
+
+FrameCapture &FeedConnection::frame_capture() {
+  static FrameCapture capture;
+  return capture;
+}
+
+FeedConnection::FeedConnection(const std::string &base_url) : base_url_(base_url) {
+  this->client_.onMessage([this](websockets::WebsocketsMessage message) {
+    this->on_message_(message);
+  });
+
+  this->client_.onEvent([this](websockets::WebsocketsEvent event, String data) {
+    this->on_event_(event);
+  });
+}
+
+uint32_t FeedConnection::subscribe(MessageCallback on_message, EventCallback on_event) {
+  uint32_t id = this->next_subscription_id_++;
+  this->subscribers_.push_back(Subscriber{id, std::move(on_message), std::move(on_event)});
+  return id;
+}
+
+void FeedConnection::poll(uint32_t subscription_id) {
+  if (this->subscribers_.empty() || this->subscribers_.front().id != subscription_id) {
+    return;
+  }
+
+  this->client_.poll();
+}
+
+void FeedConnection::on_message_(websockets::WebsocketsMessage &message) {
+  this->received_at_us = micros();
+
+  // The message is this call's own copy of the frame, so its buffer can be
+  // parsed in place: with a mutable input ArduinoJson stores strings as
+  // pointers into it instead of duplicating them into the document. The
+  // parsed document must not outlive `message`.
+  const std::string &raw = message.rawData();
+  char *payload = const_cast<char *>(raw.data());
+
+  // Parsing in place rewrites the buffer, so capture and log it first
+  FeedConnection::frame_capture().record(this, raw.data(), raw.size());
+  log_payload(ESPHOME_LOG_LEVEL_VERBOSE, TAG, "Received message", raw.data(), raw.size());
+
+  this->dispatch(payload, raw.size());
+}
+
+void FeedConnection::dispatch(char *payload, size_t length) {
+  AllocScope alloc_scope(ALLOC_CATEGORY_PARSE);
+  const size_t limit = document_limit_ > 0 ? document_limit_ : SCHEDULE_JSON_CAPACITY;
+  size_t capacity = estimate_document_capacity(payload, length);
+  if (capacity > limit) {
+    ESP_LOGW(TAG, "Frame of %u bytes may need %u bytes to parse; limited to %u", length, capacity, limit);
+    capacity = limit;
+  }
+
+  Arena &arena = FeedConnection::parse_arena();
+  arena.reset();
+  const size_t arena_capacity = arena.capacity();
+  if (arena.is_initialized() && arena.reserve(capacity + alignof(max_align_t), limit + alignof(max_align_t)) &&
+      arena.capacity() != arena_capacity) {
+    ESP_LOGD(TAG, "Grew parse arena to %u bytes", arena.capacity());
+  }
+  BasicJsonDocument<ArenaAllocator> doc(arena.is_initialized() ? capacity : 0, ArenaAllocator(&arena));
+
+  JsonObject root;
+  this->last_parse_failed = true;
+  if (doc.capacity() == 0) {
+    ESP_LOGE(TAG, "No memory for a %u byte JSON doc", capacity);
+  } else if (DeserializationError err = deserializeJson(doc, payload, length, DeserializationOption::Filter(message_filter()))) {
+    ESP_LOGE(TAG, "Failed to parse message from %s: %s", this->base_url_.c_str(), err.c_str());
+  } else {
+    root = doc.as<JsonObject>();
+    this->last_parse_failed = false;
+  }
+  this->last_document_bytes = doc.memoryUsage();
+  document_high_water_ = std::max(document_high_water_, this->last_document_bytes);
+
+  const char *event = root["event"] | "";
+  if (strcmp(event, "heartbeat") == 0) {
+    ESP_LOGD(TAG, "Received heartbeat");
+    this->last_heartbeat = millis();
+    return;
+  }
+
+  // Frames without a subscription ID (errors, or servers that predate
+  // them) go to every subscriber, except schedules: delivered to the wrong
+  // tracker, they would replace its trips with ones for stops it does not
+  // show
+  JsonVariant subscription_id = root["data"]["subscriptionId"];
+  if (subscription_id.isNull() && this->subscribers_.size() > 1 && strcmp(event, "schedule") == 0) {
+    if (!this->warned_unrouted_) {
+      ESP_LOGE(TAG, "%s sends schedules without a subscriptionId, so they cannot be routed on a shared "
+               "connection; disable share_connection", this->base_url_.c_str());
+      this->warned_unrouted_ = true;
+    }
+    return;
+  }
+
+  for (auto &subscriber : this->subscribers_) {
+    if (subscription_id.isNull() || subscription_id.as<uint32_t>() == subscriber.id) {
+      subscriber.on_message(root);
+    }
+  }
+}
+
+void FeedConnection::on_event_(websockets::WebsocketsEvent event) {
+  for (auto &subscriber : this->subscribers_) {
+    subscriber.on_event(event);
+  }
+}
+
+}  // namespace transit_tracker
+}  // namespace esphome
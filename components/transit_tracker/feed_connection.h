@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <ArduinoJson.h>
+#include <ArduinoWebsockets.h>
+
+#include "arena.h"
+#include "frame_log.h"
+
+namespace esphome {
+namespace transit_tracker {
+
+// Default ceiling for an inbound JSON document (bytes); see
+// FeedConnection::raise_document_limit().
+static const size_t SCHEDULE_JSON_CAPACITY = 48 * 1024;
+
+// A websocket connection to one server. If the server echoes subscription
+// IDs, one connection can be shared by every tracker instance on the device
+// that subscribes to it, so each server costs one TLS session: subscribers
+// tag their subscribe frame with the ID handed out here, and inbound frames
+// are parsed once and routed by the subscriptionId they carry.
+class FeedConnection {
+  public:
+    // `root` lives in the shared parse arena and borrows its strings from
+    // the receive buffer, so it is only valid for the duration of the call;
+    // it is null if the frame could not be parsed.
+    using MessageCallback = std::function<void(JsonObject root)>;
+    using EventCallback = std::function<void(websockets::WebsocketsEvent event)>;
+
+    // Returns a shared connection for `base_url`, creating it on first use,
+    // or a new connection of its own if `shared` is false.
+    static FeedConnection *get(const std::string &base_url, bool shared);
+    // Backs every inbound document; frames are handled one at a time on the
+    // main loop, so one arena serves all connections and trackers.
+    static Arena &parse_arena();
+    // Raw inbound frames of all connections, captured before parsing
+    static FrameCapture &frame_capture();
+    // Inbound documents are sized from each frame, up to a device-wide
+    // ceiling; the largest limit asked for by any tracker applies.
+    static void raise_document_limit(size_t limit) { document_limit_ = std::max(document_limit_, limit); }
+    static size_t document_limit() { return document_limit_; }
+    // Largest document pool used by any frame so far
+    static size_t document_high_water() { return document_high_water_; }
+
+    FeedConnection(const FeedConnection &) = delete;
+    FeedConnection &operator=(const FeedConnection &) = delete;
+
+    uint32_t subscribe(MessageCallback on_message, EventCallback on_event);
+    size_t subscriber_count() const { return subscribers_.size(); }
+    // Whether other subscribers may share this connection
+    bool is_shared() const { return shared_; }
+
+    // Parses a frame in place and routes it to its subscribers, as if it had
+    // just been received; the buffer is modified.
+    void dispatch(char *payload, size_t length);
+
+    // Polling is driven by the first subscriber only, so the socket is read
+    // once per loop however many trackers share it.
+    void poll(uint32_t subscription_id);
+
+    const std::string &base_url() const { return base_url_; }
+    websockets::WebsocketsClient &client() { return client_; }
+
+    int connection_attempts = 0;
+    long last_heartbeat = 0;
+    // micros() when the frame being dispatched was received
+    uint32_t received_at_us = 0;
+    // Outcome and document pool usage of the last parse
+    bool last_parse_failed = false;
+    size_t last_document_bytes = 0;
+    // millis() of the next scheduled connection attempt; 0 if none is pending
+    uint32_t next_attempt = 0;
+
+  protected:
+    explicit FeedConnection(const std::string &base_url);
+
+    struct Subscriber {
+      uint32_t id;
+      MessageCallback on_message;
+      EventCallback on_event;
+    };
+
+    void on_message_(websockets::WebsocketsMessage &message);
+    void on_event_(websockets::WebsocketsEvent event);
+
+    std::string base_url_;
+    websockets::WebsocketsClient client_{};
+    std::vector<Subscriber> subscribers_;
+    uint32_t next_subscription_id_ = 1;
+    bool shared_ = false;
+    bool warned_unrouted_ = false;
+
+    static size_t document_limit_;
+    static size_t document_high_water_;
+};
+
+}  // namespace transit_tracker
+}  // namespace esphome
@@ -0,0 +1,145 @@
+#include "frame_log.h"
+
+#include "esphome/core/defines.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/log.h"
+#ifdef USE_LOGGER
+#include "esphome/components/logger/logger.h"
+#endif
+
+#include <algorithm>
+#include <string.h>
+
+#include "Arduino.h"
+
+extern "C" {
+  #include "esp_heap_caps.h"
+}
+
+namespace esphome {
+namespace transit_tracker {
+
+// Characters of a text payload shown in a summary
+static const size_t PREVIEW_LENGTH = 96;
+// Bytes of a binary payload shown in a summary
+static const size_t HEX_PREVIEW_LENGTH = 32;
+// Keeps each dumped line within the logger's buffer
+static const size_t DUMP_CHUNK_SIZE = 256;
+
+bool log_level_enabled(int level, const char *tag) {
+  if (level > ESPHOME_LOG_LEVEL) {
+    return false;
+  }
+#ifdef USE_LOGGER
+  if (logger::global_logger != nullptr && level > logger::global_logger->level_for(tag)) {
+    return false;
+  }
+#endif
+  return true;
+}
+
+void log_payload(int level, const char *tag, const char *label, const char *data, size_t length) {
+  if (!log_level_enabled(level, tag)) {
+    return;
+  }
+
+  size_t preview = std::min(length, PREVIEW_LENGTH);
+  bool printable = std::all_of(data, data + preview, [](char c) { return c >= 0x20 && c < 0x7F; });
+  const char *ellipsis = preview < length ? "..." : "";
+
+  if (printable) {
+    esp_log_printf_(level, tag, __LINE__, "%s (%u bytes): %.*s%s", label, length, static_cast<int>(preview), data,
+                    ellipsis);
+  } else {
+    preview = std::min(length, HEX_PREVIEW_LENGTH);
+    std::string hex = format_hex_pretty(reinterpret_cast<const uint8_t *>(data), preview);
+    esp_log_printf_(level, tag, __LINE__, "%s (%u bytes): %s%s", label, length, hex.c_str(),
+                    preview < length ? " ..." : "");
+  }
+}
+
+FrameCapture::~FrameCapture() {
+  if (this->buffer_ != nullptr) {
+    heap_caps_free(this->buffer_);
+  }
+}
+
+bool FrameCapture::init(size_t max_frames, size_t buffer_size) {
+  if (this->buffer_ != nullptr) {
+    heap_caps_free(this->buffer_);
+    this->buffer_ = nullptr;
+  }
+
+  this->records_.clear();
+  this->write_offset_ = 0;
+  this->max_frames_ = max_frames;
+  this->buffer_size_ = 0;
+
+  if (max_frames == 0 || buffer_size == 0) {
+    return true;
+  }
+
+  this->buffer_ = static_cast<char *>(heap_caps_malloc(buffer_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+  if (this->buffer_ == nullptr) {
+    return false;
+  }
+
+  this->buffer_size_ = buffer_size;
+  return true;
+}
+
+void FrameCapture::record(const void *source, const char *data, size_t length) {
+  if (this->buffer_ == nullptr) {
+    return;
+  }
+
+  size_t stored = std::min(length, this->buffer_size_);
+
+  // Frames are never split across the end of the buffer. On wrapping, the
+  // frames left between the write offset and the end are the oldest ones.
+  if (stored > this->buffer_size_ - this->write_offset_) {
+    while (!this->records_.empty() && this->records_.front().offset >= this->write_offset_) {
+      this->records_.pop_front();
+    }
+    this->write_offset_ = 0;
+  }
+
+  const size_t start = this->write_offset_;
+  const size_t end = start + stored;
+  while (!this->records_.empty() && (this->records_.size() >= this->max_frames_ ||
+                                     (this->records_.front().offset < end &&
+                                      this->records_.front().offset + this->records_.front().length > start))) {
+    this->records_.pop_front();
+  }
+
+  memcpy(this->buffer_ + start, data, stored);
+  this->records_.push_back(Record{start, stored, length, ++this->recorded_, millis(), source});
+  this->write_offset_ = end;
+}
+
+void FrameCapture::for_each(const std::function<void(const CapturedFrame &)> &callback) const {
+  for (const Record &record : this->records_) {
+    callback(CapturedFrame{record.sequence, record.received_at, record.source, this->buffer_ + record.offset,
+                           record.length, record.original_length});
+  }
+}
+
+void FrameCapture::dump(const char *tag) const {
+  if (this->buffer_ == nullptr) {
+    ESP_LOGI(tag, "Frame capture is disabled");
+    return;
+  }
+
+  ESP_LOGI(tag, "Captured frames (%u of %u recorded in total):", this->records_.size(), this->recorded_);
+  this->for_each([tag](const CapturedFrame &frame) {
+    ESP_LOGI(tag, "  Frame #%u at %ums, %u bytes%s:", frame.sequence, frame.received_at, frame.original_length,
+             frame.length < frame.original_length ? " (truncated)" : "");
+    for (size_t offset = 0; offset < frame.length; offset += DUMP_CHUNK_SIZE) {
+      int chunk = std::min(DUMP_CHUNK_SIZE, frame.length - offset);
+      ESP_LOGI(tag, "    %.*s", chunk, frame.data + offset);
+    }
+  });
+}
+
+}  // namespace transit_tracker
+}  // namespace esphome
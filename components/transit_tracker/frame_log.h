@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+
+namespace esphome {
+namespace transit_tracker {
+
+// True if a message at `level` for `tag` would reach the log, taking both
+// the compile-time level and the logger's runtime level into account.
+bool log_level_enabled(int level, const char *tag);
+
+// Logs the size and a short preview of a large payload, as text if it is
+// printable and as hex otherwise. The payload is not touched unless the
+// level is enabled.
+void log_payload(int level, const char *tag, const char *label, const char *data, size_t length);
+
+struct CapturedFrame {
+  uint32_t sequence;
+  // millis() when the frame was received
+  uint32_t received_at;
+  // Opaque tag of the frame's origin, e.g. the connection it arrived on
+  const void *source;
+  const char *data;
+  size_t length;
+  // Size of the original frame; larger than `length` if it was truncated
+  size_t original_length;
+};
+
+// Records the last N raw frames, timestamped, for on-demand inspection and
+// replay. Frames are stored back to back in a single PSRAM ring buffer
+// allocated up front, so recording never allocates; the oldest frames are
+// dropped as the buffer wraps or the frame limit is reached.
+class FrameCapture {
+  public:
+    ~FrameCapture();
+
+    bool init(size_t max_frames, size_t buffer_size);
+    bool is_enabled() const { return buffer_ != nullptr; }
+    size_t max_frames() const { return max_frames_; }
+    size_t buffer_size() const { return buffer_size_; }
+    size_t size() const { return records_.size(); }
+
+    void record(const void *source, const char *data, size_t length);
+    // Visits the captured frames, oldest first
+    void for_each(const std::function<void(const CapturedFrame &)> &callback) const;
+    // Logs every captured frame, oldest first, in chunks the logger can hold
+    void dump(const char *tag) const;
+
+  protected:
+    struct Record {
+      size_t offset;
+      size_t length;
+      size_t original_length;
+      uint32_t sequence;
+      uint32_t received_at;
+      const void *source;
+    };
+
+    char *buffer_ = nullptr;
+    size_t buffer_size_ = 0;
+    size_t max_frames_ = 0;
+    size_t write_offset_ = 0;
+    uint32_t recorded_ = 0;
+    std::deque<Record> records_;
+};
+
+}  // namespace transit_tracker
+}  // namespace esphome
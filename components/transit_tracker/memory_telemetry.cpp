@@ -0,0 +1,138 @@
+#include "memory_telemetry.h"
+
+#include "esphome/core/defines.h"
+#include "esphome/core/log.h"
+
+#include <new>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+extern "C" {
+  #include "esp_heap_caps.h"
+}
+
+namespace esphome {
+namespace transit_tracker {
+
+std::atomic<uint32_t> MemoryTelemetry::alloc_counts_[ALLOC_CATEGORY_COUNT] = {};
+
+// Active scopes are kept in a few fixed per-task slots rather than in a
+// thread_local: operator new also runs for static constructors, before the
+// scheduler has started or any task exists. Only the owning task reads or
+// writes a claimed slot's category.
+static const size_t MAX_SCOPED_TASKS = 4;
+
+struct TaskScope {
+  std::atomic<TaskHandle_t> task;
+  AllocCategory category;
+};
+
+static TaskScope task_scopes[MAX_SCOPED_TASKS] = {};
+
+static TaskScope *find_task_scope(TaskHandle_t task) {
+  for (TaskScope &scope : task_scopes) {
+    if (scope.task.load(std::memory_order_acquire) == task) {
+      return &scope;
+    }
+  }
+  return nullptr;
+}
+
+AllocCategory MemoryTelemetry::current_category() {
+  if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) {
+    return ALLOC_CATEGORY_COUNT;
+  }
+  TaskScope *scope = find_task_scope(xTaskGetCurrentTaskHandle());
+  return scope != nullptr ? scope->category : ALLOC_CATEGORY_COUNT;
+}
+
+void MemoryTelemetry::set_current_category(AllocCategory category) {
+  if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) {
+    return;
+  }
+
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  TaskScope *scope = find_task_scope(task);
+  if (category == ALLOC_CATEGORY_COUNT) {
+    // The task's outermost scope ended; free its slot
+    if (scope != nullptr) {
+      scope->task.store(nullptr, std::memory_order_release);
+    }
+    return;
+  }
+
+  if (scope == nullptr) {
+    for (TaskScope &candidate : task_scopes) {
+      TaskHandle_t empty = nullptr;
+      if (candidate.task.compare_exchange_strong(empty, task, std::memory_order_acq_rel)) {
+        scope = &candidate;
+        break;
+      }
+    }
+    if (scope == nullptr) {
+      return;  // More tasks in scopes than slots; this one goes uncounted
+    }
+  }
+  scope->category = category;
+}
+
+static void sample_heap(HeapStats &stats, uint32_t caps) {
+  stats.total = heap_caps_get_total_size(caps);
+  stats.free = heap_caps_get_free_size(caps);
+  stats.min_free = heap_caps_get_minimum_free_size(caps);
+  stats.largest_free_block = heap_caps_get_largest_free_block(caps);
+
+  if (stats.total > 0 && stats.largest_free_block < stats.min_largest_free_block) {
+    stats.min_largest_free_block = stats.largest_free_block;
+  }
+}
+
+void MemoryTelemetry::sample() {
+  sample_heap(this->internal_, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  sample_heap(this->psram_, MALLOC_CAP_SPIRAM);
+}
+
+void MemoryTelemetry::log(const char *tag) const {
+  ESP_LOGCONFIG(tag, "  Internal heap: %u free / %u total (min free %u, largest block %u, min largest block %u)",
+                this->internal_.free, this->internal_.total, this->internal_.min_free,
+                this->internal_.largest_free_block, this->internal_.min_largest_free_block);
+
+  if (this->psram_.total > 0) {
+    ESP_LOGCONFIG(tag, "  PSRAM: %u free / %u total (min free %u, largest block %u, min largest block %u)",
+                  this->psram_.free, this->psram_.total, this->psram_.min_free,
+                  this->psram_.largest_free_block, this->psram_.min_largest_free_block);
+  } else {
+    ESP_LOGCONFIG(tag, "  PSRAM: not available");
+  }
+
+  ESP_LOGCONFIG(tag, "  Allocations: parse=%u, render=%u, tls=%u",
+                get_alloc_count(ALLOC_CATEGORY_PARSE),
+                get_alloc_count(ALLOC_CATEGORY_RENDER),
+                get_alloc_count(ALLOC_CATEGORY_TLS));
+}
+
+}  // namespace transit_tracker
+}  // namespace esphome
+
+#ifdef USE_TRANSIT_TRACKER_ALLOC_TRACKING
+// Replaces the global operator new so C++ allocations (std::string,
+// std::vector, ...) made inside an AllocScope are counted. Only compiled in
+// when an allocation sensor is configured; the matching operator delete is
+// the default, which frees with free().
+static void *counted_new(size_t size) {
+  void *ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+#ifdef __cpp_exceptions
+    throw std::bad_alloc();
+#else
+    abort();
+#endif
+  }
+  esphome::transit_tracker::MemoryTelemetry::record_scoped_alloc();
+  return ptr;
+}
+
+void *operator new(size_t size) { return counted_new(size); }
+void *operator new[](size_t size) { return counted_new(size); }
+#endif
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+namespace esphome {
+namespace transit_tracker {
+
+enum AllocCategory : uint8_t {
+  ALLOC_CATEGORY_PARSE,
+  ALLOC_CATEGORY_RENDER,
+  ALLOC_CATEGORY_TLS,
+  ALLOC_CATEGORY_COUNT
+};
+
+struct HeapStats {
+  size_t total = 0;
+  size_t free = 0;
+  size_t min_free = 0;
+  size_t largest_free_block = 0;
+  // Lowest largest-free-block seen since boot; a shrinking value with
+  // roughly constant free memory points to fragmentation.
+  size_t min_largest_free_block = SIZE_MAX;
+};
+
+class MemoryTelemetry {
+  public:
+    static void record_alloc(AllocCategory category) { alloc_counts_[category].fetch_add(1, std::memory_order_relaxed); }
+    static uint32_t get_alloc_count(AllocCategory category) { return alloc_counts_[category].load(std::memory_order_relaxed); }
+
+    // Counts an allocation against the calling task's active AllocScope, if any
+    static void record_scoped_alloc() {
+      AllocCategory category = current_category();
+      if (category != ALLOC_CATEGORY_COUNT) {
+        record_alloc(category);
+      }
+    }
+    // Per task, as the config fetcher parses on its own task;
+    // ALLOC_CATEGORY_COUNT outside any scope
+    static AllocCategory current_category();
+    static void set_current_category(AllocCategory category);
+
+    void sample();
+    void log(const char *tag) const;
+
+    const HeapStats &get_internal() const { return internal_; }
+    const HeapStats &get_psram() const { return psram_; }
+
+  protected:
+    static std::atomic<uint32_t> alloc_counts_[ALLOC_CATEGORY_COUNT];
+
+    HeapStats internal_;
+    HeapStats psram_;
+};
+
+// While alive, heap allocations the calling task makes through operator new
+// (with allocation tracking compiled in) or a CountingAllocator are counted
+// against `category`. Scopes nest.
+class AllocScope {
+  public:
+    explicit AllocScope(AllocCategory category) : previous_(MemoryTelemetry::current_category()) {
+      MemoryTelemetry::set_current_category(category);
+    }
+    ~AllocScope() { MemoryTelemetry::set_current_category(previous_); }
+    AllocScope(const AllocScope &) = delete;
+    AllocScope &operator=(const AllocScope &) = delete;
+
+  protected:
+    AllocCategory previous_;
+};
+
+// Allocator adapter for ArduinoJson documents on the regular heap, counting
+// each allocation against the active AllocScope
+class CountingAllocator {
+  public:
+    void *allocate(size_t size) {
+      void *ptr = malloc(size);
+      if (ptr != nullptr) {
+        MemoryTelemetry::record_scoped_alloc();
+      }
+      return ptr;
+    }
+    void *reallocate(void *ptr, size_t new_size) {
+      void *resized = realloc(ptr, new_size);
+      if (resized != nullptr && resized != ptr) {
+        MemoryTelemetry::record_scoped_alloc();
+      }
+      return resized;
+    }
+    void deallocate(void *ptr) { free(ptr); }
+};
+
+}  // namespace transit_tracker
+}  // namespace esphome
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string.h>
+
+namespace esphome {
+namespace transit_tracker {
+
+static const size_t PERSISTED_CONFIG_SIZE = 2048;
+static const size_t PERSISTED_SCHEDULE_SIZE = 2048;
+static const size_t PERSISTED_TIMETABLE_SIZE = 2048;
+
+// Fixed-size flash record holding a length-prefixed, checksummed payload,
+// as ESPHome preferences only store trivially copyable types.
+template<size_t N> struct PersistedBlob {
+  uint16_t length;
+  uint32_t checksum;
+  uint8_t data[N];
+
+  static uint32_t compute_checksum(const uint8_t *data, size_t length) {
+    // FNV-1a
+    uint32_t hash = 2166136261UL;
+    for (size_t i = 0; i < length; i++) {
+      hash ^= data[i];
+      hash *= 16777619UL;
+    }
+    return hash;
+  }
+
+  bool is_valid() const { return length <= N && checksum == compute_checksum(data, length); }
+  void seal(size_t new_length) {
+    length = new_length;
+    checksum = compute_checksum(data, length);
+  }
+};
+
+class BlobWriter {
+  public:
+    BlobWriter(uint8_t *data, size_t capacity) : data_(data), capacity_(capacity) {}
+
+    bool write_u8(uint8_t value) { return this->write_bytes_(&value, 1); }
+    bool write_u32(uint32_t value) { return this->write_bytes_(&value, sizeof(value)); }
+    // Strings are length-prefixed with 16 bits
+    bool write_string(const char *str, size_t length) {
+      if (length > UINT16_MAX) {
+        return false;
+      }
+      uint16_t prefix = length;
+      return this->write_bytes_(&prefix, sizeof(prefix)) && this->write_bytes_(str, length);
+    }
+
+    size_t size() const { return size_; }
+    // Remembers the current size so a partially written record can be undone
+    size_t mark() const { return size_; }
+    void rewind(size_t mark) { size_ = mark; }
+
+  protected:
+    bool write_bytes_(const void *src, size_t length) {
+      if (length > this->capacity_ - this->size_) {
+        return false;
+      }
+      memcpy(this->data_ + this->size_, src, length);
+      this->size_ += length;
+      return true;
+    }
+
+    uint8_t *data_;
+    size_t capacity_;
+    size_t size_ = 0;
+};
+
+class BlobReader {
+  public:
+    BlobReader(const uint8_t *data, size_t size) : data_(data), size_(size) {}
+
+    bool read_u8(uint8_t &value) { return this->read_bytes_(&value, 1); }
+    bool read_u32(uint32_t &value) { return this->read_bytes_(&value, sizeof(value)); }
+    // Points `str` into the blob; the string is not NUL-terminated
+    bool read_string(const char *&str, size_t &length) {
+      uint16_t prefix;
+      if (!this->read_bytes_(&prefix, sizeof(prefix)) || prefix > this->size_ - this->offset_) {
+        return false;
+      }
+      str = reinterpret_cast<const char *>(this->data_ + this->offset_);
+      length = prefix;
+      this->offset_ += prefix;
+      return true;
+    }
+
+    bool at_end() const { return offset_ >= size_; }
+
+  protected:
+    bool read_bytes_(void *dst, size_t length) {
+      if (length > this->size_ - this->offset_) {
+        return false;
+      }
+      memcpy(dst, this->data_ + this->offset_, length);
+      this->offset_ += length;
+      return true;
+    }
+
+    const uint8_t *data_;
+    size_t size_;
+    size_t offset_ = 0;
+};
+
+}  // namespace transit_tracker
+}  // namespace esphome
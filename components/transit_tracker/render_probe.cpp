@@ -0,0 +1,38 @@
+#include "render_probe.h"
+
+#include "Arduino.h"
+
+namespace esphome {
+namespace transit_tracker {
+
+static inline uint32_t fnv1a_step(uint32_t hash, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    hash ^= (value >> (i * 8)) & 0xFF;
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+void RenderProbe::begin(display::Display *target) {
+  this->target_ = target;
+  this->stats_ = RenderStats{};
+  this->started_at_ = micros();
+}
+
+void RenderProbe::end() {
+  this->stats_.duration_us = micros() - this->started_at_;
+}
+
+void RenderProbe::draw_pixel_at(int x, int y, Color color) {
+  if (!this->get_clipping().inside(x, y)) {
+    this->stats_.clipped_pixels++;
+    return;
+  }
+
+  this->stats_.pixels++;
+  this->stats_.hash = fnv1a_step(this->stats_.hash, (static_cast<uint32_t>(x) << 16) | (y & 0xFFFF));
+  this->stats_.hash = fnv1a_step(this->stats_.hash, (color.r << 16) | (color.g << 8) | color.b);
+}
+
+}  // namespace transit_tracker
+}  // namespace esphome
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+#include "esphome/components/display/display.h"
+
+namespace esphome {
+namespace transit_tracker {
+
+struct RenderStats {
+  uint32_t pixels = 0;
+  // Pixels dropped by the active clipping rectangle
+  uint32_t clipped_pixels = 0;
+  // FNV-1a over the position and color of every pixel drawn, in order;
+  // two renders hash equal if they produced the same output
+  uint32_t hash = 2166136261UL;
+  uint32_t duration_us = 0;
+};
+
+// A display that draws nowhere: it takes the dimensions of a real display
+// and records what a render would have put on it. Swapped in for the real
+// display, it lets a page be rendered and measured without touching the
+// panel.
+class RenderProbe : public display::Display {
+  public:
+    void begin(display::Display *target);
+    void end();
+    const RenderStats &stats() const { return stats_; }
+
+    void update() override {}
+    display::DisplayType get_display_type() override { return target_->get_display_type(); }
+    void draw_pixel_at(int x, int y, Color color) override;
+
+  protected:
+    int get_width_internal() override { return target_->get_width(); }
+    int get_height_internal() override { return target_->get_height(); }
+
+    display::Display *target_ = nullptr;
+    RenderStats stats_;
+    uint32_t started_at_ = 0;
+};
+
+}  // namespace transit_tracker
+}  // namespace esphome
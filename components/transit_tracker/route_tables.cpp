@@ -0,0 +1,118 @@
+#include "route_tables.h"
+
+#include <algorithm>
+
+namespace esphome {
+namespace transit_tracker {
+
+void RouteStyleTable::clear() {
+  this->entries_.clear();
+  this->slots_.clear();
+  this->text_.clear();
+}
+
+void RouteStyleTable::reserve(size_t count) {
+  this->entries_.reserve(count);
+  size_t slot_count = 8;
+  while (slot_count < 2 * count) {
+    slot_count *= 2;
+  }
+  if (slot_count > this->slots_.size()) {
+    this->rehash_(slot_count);
+  }
+}
+
+void RouteStyleTable::insert(const char *route_id, size_t length, const char *name, size_t name_length,
+                             const Color &color) {
+  const uint32_t hash = hash_(route_id, length);
+  int slot = this->slots_.empty() ? -1 : this->find_slot_(hash, route_id, length);
+  if (slot >= 0 && this->slots_[slot] != EMPTY_SLOT) {
+    Entry &entry = this->entries_[this->slots_[slot]];
+    entry.name = this->append_text_(name, name_length);
+    entry.color = color;
+    return;
+  }
+
+  if (2 * (this->entries_.size() + 1) > this->slots_.size()) {
+    this->reserve(std::max<size_t>(2 * this->entries_.size(), 4));
+    slot = this->find_slot_(hash, route_id, length);
+  }
+
+  Entry entry;
+  entry.hash = hash;
+  entry.route_id = this->append_text_(route_id, length);
+  entry.route_id_length = length;
+  entry.name = this->append_text_(name, name_length);
+  entry.color = color;
+  this->slots_[slot] = this->entries_.size();
+  this->entries_.push_back(entry);
+}
+
+bool RouteStyleTable::find(const char *route_id, size_t length, const char **name, Color *color) const {
+  if (this->entries_.empty()) {
+    return false;
+  }
+
+  const int slot = this->find_slot_(hash_(route_id, length), route_id, length);
+  if (this->slots_[slot] == EMPTY_SLOT) {
+    return false;
+  }
+
+  const Entry &entry = this->entries_[this->slots_[slot]];
+  *name = this->text_.data() + entry.name;
+  *color = entry.color;
+  return true;
+}
+
+size_t RouteStyleTable::memory_usage() const {
+  return this->entries_.capacity() * sizeof(Entry) + this->slots_.capacity() * sizeof(uint32_t) +
+         this->text_.capacity();
+}
+
+uint32_t RouteStyleTable::hash_(const char *data, size_t length) {
+  // FNV-1a
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+// Slot holding the route, or the empty slot where it would go
+int RouteStyleTable::find_slot_(uint32_t hash, const char *route_id, size_t length) const {
+  const size_t mask = this->slots_.size() - 1;
+  for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+    const uint32_t index = this->slots_[slot];
+    if (index == EMPTY_SLOT) {
+      return slot;
+    }
+    const Entry &entry = this->entries_[index];
+    if (entry.hash == hash && entry.route_id_length == length &&
+        memcmp(this->text_.data() + entry.route_id, route_id, length) == 0) {
+      return slot;
+    }
+  }
+}
+
+void RouteStyleTable::rehash_(size_t slot_count) {
+  this->slots_.assign(slot_count, EMPTY_SLOT);
+  const size_t mask = slot_count - 1;
+  for (size_t i = 0; i < this->entries_.size(); i++) {
+    size_t slot = this->entries_[i].hash & mask;
+    while (this->slots_[slot] != EMPTY_SLOT) {
+      slot = (slot + 1) & mask;
+    }
+    this->slots_[slot] = i;
+  }
+}
+
+uint32_t RouteStyleTable::append_text_(const char *str, size_t length) {
+  const uint32_t offset = this->text_.size();
+  this->text_.append(str, length);
+  this->text_.push_back('\0');
+  return offset;
+}
+
+}  // namespace transit_tracker
+}  // namespace esphome
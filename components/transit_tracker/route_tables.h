@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <string.h>
+
+#include "esphome/components/display/display.h"
+
+namespace esphome {
+namespace transit_tracker {
+
+// Route styles and abbreviations declared in YAML are emitted by codegen as
+// constant tables sorted by key, so they live in flash rather than in heap
+// maps built at boot.
+
+struct StaticRouteStyle {
+  const char *route_id;
+  const char *name;
+  // The YAML color, which ESPHome keeps in a global
+  const Color *color;
+};
+
+struct StaticAbbreviation {
+  const char *from;
+  size_t from_length;
+  const char *to;
+  size_t to_length;
+};
+
+// Binary search of a table sorted by route ID, in byte order
+inline const StaticRouteStyle *find_static_route_style(const StaticRouteStyle *table, size_t size,
+                                                       const char *route_id, size_t length) {
+  size_t low = 0;
+  size_t high = size;
+  while (low < high) {
+    const size_t mid = (low + high) / 2;
+    const char *key = table[mid].route_id;
+    int order = strncmp(key, route_id, length);
+    if (order == 0 && key[length] != '\0') {
+      order = 1;  // `key` is longer, so it sorts after
+    }
+
+    if (order == 0) {
+      return &table[mid];
+    }
+    if (order < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return nullptr;
+}
+
+// Route styles loaded at runtime, which can run to hundreds of entries, in
+// an open-addressing hash table. Entries sit in one flat array and their
+// strings in one shared buffer; the slot array holds entry indices, probed
+// linearly, and each entry keeps its key's hash so most mismatches are
+// rejected without a string compare.
+class RouteStyleTable {
+  public:
+    void clear();
+    // Sizes the table for `count` entries so inserting them does not rehash
+    void reserve(size_t count);
+    // Adds a style, replacing any previous one for the route
+    void insert(const char *route_id, size_t length, const char *name, size_t name_length, const Color &color);
+    // Display name and color of a route; false if it has no style
+    bool find(const char *route_id, size_t length, const char **name, Color *color) const;
+
+    size_t size() const { return entries_.size(); }
+    size_t memory_usage() const;
+
+  protected:
+    struct Entry {
+      uint32_t hash;
+      // Offsets into `text_` of the NUL-terminated route ID and name
+      uint32_t route_id;
+      uint32_t route_id_length;
+      uint32_t name;
+      Color color;
+    };
+
+    static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+
+    static uint32_t hash_(const char *data, size_t length);
+    int find_slot_(uint32_t hash, const char *route_id, size_t length) const;
+    void rehash_(size_t slot_count);
+    uint32_t append_text_(const char *str, size_t length);
+
+    std::vector<Entry> entries_;
+    // Power-of-two sized, at most half full
+    std::vector<uint32_t> slots_;
+    std::string text_;
+};
+
+}  // namespace transit_tracker
+}  // namespace esphome
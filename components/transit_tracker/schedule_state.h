@@ -1,29 +1,323 @@
 #pragma once
 
+#include <algorithm>
+#include <memory>
+#include <string>
 #include <vector>
 #include <mutex>
+#include <string.h>
 
+#include "esphome/core/string_ref.h"
 #include "esphome/components/display/display.h"
 
+#include "arena.h"
+
 namespace esphome {
 namespace transit_tracker {
 
+// Text fields reference NUL-terminated copies in the arena of the schedule
+// generation the trip belongs to; they are valid until that generation is
+// retired.
 class Trip {
   public:
-    std::string stop_id;
-    std::string route_id;
-    std::string route_name;
+    StringRef stop_id;
+    StringRef route_id;
+    StringRef route_name;
     Color route_color;
-    std::string headsign;
+    StringRef headsign;
     time_t arrival_time;
     time_t departure_time;
     bool is_realtime;
+    // Index of the feed source the trip came from
+    uint8_t source;
+
+    // Render-ready fields, filled in once when the trip is stored rather
+    // than on every frame
+    // Arrival or departure time, whichever the display shows
+    time_t display_time;
+    Color time_color;
+    int16_t route_name_width;
+    int16_t headsign_width;
+    int16_t line_height;
+};
+
+// The trips of one stop, soonest first.
+struct TripSpan {
+  const Trip *first;
+  size_t count;
+
+  const Trip *begin() const { return first; }
+  const Trip *end() const { return first + count; }
+  bool empty() const { return count == 0; }
 };
 
+// Trips are kept per configured stop, at most `trips_per_stop` each: a
+// fixed block of slots per stop holds the soonest trips in order, and later
+// ones are turned away while parsing. Trips may borrow their strings while
+// the generation is built and copy them in with for_each_pending() once it
+// is final, so storage is O(stops x K) however much the server sends.
+//
+// Slots are kept per feed source and per schedule generation: a source's
+// next generation is built on the side with begin_generation()/add(), then
+// swapped in under the mutex by commit_generation(), which retires the
+// previous generation's strings in one shot and re-merges all sources
+// into `trips`, grouped by stop.
 class ScheduleState {
   public:
     std::mutex mutex;
+    // Merged trips of all sources, grouped by stop in stop order; use
+    // trips_for_stop() for one stop's trips
     std::vector<Trip> trips;
+    // Set while `trips` was restored from a snapshot or projected offline
+    // rather than received live, until the first live update replaces it.
+    bool is_stale = false;
+    bool sort_by_departure = true;
+
+    bool init(size_t source_count, size_t arena_size, uint32_t caps) {
+      this->sources_.clear();
+      for (size_t i = 0; i < std::max<size_t>(source_count, 1); i++) {
+        std::unique_ptr<SourceGeneration> source(new SourceGeneration());
+        if (!source->arena.init(arena_size, caps, ALLOC_CATEGORY_PARSE, arena_size / 2) ||
+            !source->pending_arena.init(arena_size, caps, ALLOC_CATEGORY_PARSE, arena_size / 2)) {
+          return false;
+        }
+        this->sources_.push_back(std::move(source));
+      }
+      return true;
+    }
+
+    // Sets the stops trips are kept for and clears all trips
+    void set_stops(const std::vector<std::string> &stop_ids, size_t trips_per_stop) {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->stop_ids_ = stop_ids;
+      // Per-stop counts are kept in a byte
+      this->trips_per_stop_ = std::min<size_t>(std::max<size_t>(trips_per_stop, 1), UINT8_MAX);
+
+      const size_t slot_count = this->stop_ids_.size() * this->trips_per_stop_;
+      for (auto &source : this->sources_) {
+        source->slots.assign(slot_count, Trip{});
+        source->counts.assign(this->stop_ids_.size(), 0);
+        source->pending_slots.assign(slot_count, Trip{});
+        source->pending_counts.assign(this->stop_ids_.size(), 0);
+        source->arena.reset();
+      }
+      this->trips.clear();
+      this->trips.reserve(slot_count);
+      this->stop_offsets_.assign(this->stop_ids_.size() + 1, 0);
+    }
+
+    size_t trips_per_stop() const { return trips_per_stop_; }
+
+    // Index of a configured stop, or -1 if trips for it are not kept
+    int find_stop(const char *stop_id, size_t length) const {
+      for (size_t i = 0; i < this->stop_ids_.size(); i++) {
+        if (this->stop_ids_[i].size() == length && memcmp(this->stop_ids_[i].data(), stop_id, length) == 0) {
+          return i;
+        }
+      }
+      return -1;
+    }
+    int find_stop(const char *stop_id) const { return this->find_stop(stop_id, strlen(stop_id)); }
+
+    TripSpan trips_for_stop(size_t stop) const {
+      if (stop + 1 >= this->stop_offsets_.size()) {
+        return TripSpan{nullptr, 0};
+      }
+      return TripSpan{this->trips.data() + this->stop_offsets_[stop],
+                      this->stop_offsets_[stop + 1] - this->stop_offsets_[stop]};
+    }
+
+    void begin_generation(size_t source = 0) {
+      this->building_ = this->sources_[source].get();
+      this->building_index_ = source;
+      this->building_->pending_arena.reset();
+      std::fill(this->building_->pending_counts.begin(), this->building_->pending_counts.end(), 0);
+    }
+
+    // Whether a trip at these times would make its stop's cut in the
+    // generation being built; check before storing the trip's strings.
+    bool accepts(int stop, time_t arrival_time, time_t departure_time) const {
+      if (stop < 0 || stop >= static_cast<int>(this->stop_ids_.size())) {
+        return false;
+      }
+      if (this->building_->pending_counts[stop] < this->trips_per_stop_) {
+        return true;
+      }
+      const Trip &last = this->building_->pending_slots[(stop + 1) * this->trips_per_stop_ - 1];
+      return this->sort_time_(arrival_time, departure_time) < this->sort_time_(last);
+    }
+
+    // Inserts the trip in time order, dropping the stop's latest trip if
+    // its slots are full
+    void add(int stop, const Trip &trip) {
+      if (!this->accepts(stop, trip.arrival_time, trip.departure_time)) {
+        return;
+      }
+
+      Trip *slots = this->building_->pending_slots.data() + stop * this->trips_per_stop_;
+      uint8_t &count = this->building_->pending_counts[stop];
+      size_t position = count < this->trips_per_stop_ ? count : this->trips_per_stop_ - 1;
+      const time_t time = this->sort_time_(trip);
+      while (position > 0 && this->sort_time_(slots[position - 1]) > time) {
+        slots[position] = slots[position - 1];
+        position--;
+      }
+      slots[position] = trip;
+      if (count < this->trips_per_stop_) {
+        count++;
+      }
+    }
+
+    // Visits the trips kept so far in the generation being built, e.g. to
+    // copy strings they still borrow into the generation's arena once no
+    // more trips can push them out
+    template<typename F> void for_each_pending(F callback) {
+      for (size_t stop = 0; stop < this->building_->pending_counts.size(); stop++) {
+        Trip *slots = this->building_->pending_slots.data() + stop * this->trips_per_stop_;
+        for (uint8_t i = 0; i < this->building_->pending_counts[stop]; i++) {
+          callback(slots[i]);
+        }
+      }
+    }
+
+    size_t pending_size() const {
+      size_t size = 0;
+      for (uint8_t count : this->building_->pending_counts) {
+        size += count;
+      }
+      return size;
+    }
+
+    StringRef store(const char *str) { return this->store(str, str != nullptr ? strlen(str) : 0); }
+    StringRef store(const std::string &str) { return this->store(str.data(), str.size()); }
+    StringRef store(const char *str, size_t length) {
+      const char *copy = length > 0 ? this->building_->pending_arena.copy_string(str, length) : nullptr;
+      return copy != nullptr ? StringRef(copy, length) : StringRef();
+    }
+
+    // A stale generation stands for the whole board, and the first live one
+    // replaces whatever stale data there was, so either clears the other
+    // sources.
+    void commit_generation(bool stale = false) {
+      SourceGeneration *building = this->building_;
+      for (Trip &trip : building->pending_slots) {
+        trip.source = this->building_index_;
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (stale || this->is_stale) {
+          for (auto &source : this->sources_) {
+            if (source.get() != building) {
+              std::fill(source->counts.begin(), source->counts.end(), 0);
+              source->arena.reset();
+            }
+          }
+        }
+
+        this->is_stale = stale;
+        building->slots.swap(building->pending_slots);
+        building->counts.swap(building->pending_counts);
+        building->arena.swap(building->pending_arena);
+        this->merge_();
+      }
+
+      building->pending_arena.reset();
+      this->building_ = nullptr;
+    }
+
+    void clear() {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      for (auto &source : this->sources_) {
+        std::fill(source->counts.begin(), source->counts.end(), 0);
+        source->arena.reset();
+      }
+      this->trips.clear();
+      std::fill(this->stop_offsets_.begin(), this->stop_offsets_.end(), 0);
+    }
+
+    // Drops one source's live trips, keeping the other sources'. Stale
+    // trips stand for the whole board and are kept.
+    void clear_source(size_t source) {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (this->is_stale) {
+        return;
+      }
+      SourceGeneration &generation = *this->sources_[source];
+      std::fill(generation.counts.begin(), generation.counts.end(), 0);
+      generation.arena.reset();
+      this->merge_();
+    }
+
+    size_t generation_bytes() const {
+      size_t bytes = 0;
+      for (const auto &source : this->sources_) {
+        bytes += source->arena.used();
+      }
+      return bytes;
+    }
+
+  protected:
+    struct SourceGeneration {
+      Arena arena;
+      Arena pending_arena;
+      // trips_per_stop slots per stop, the first counts[stop] of them used
+      std::vector<Trip> slots;
+      std::vector<uint8_t> counts;
+      std::vector<Trip> pending_slots;
+      std::vector<uint8_t> pending_counts;
+    };
+
+    time_t sort_time_(time_t arrival_time, time_t departure_time) const {
+      return this->sort_by_departure ? departure_time : arrival_time;
+    }
+    time_t sort_time_(const Trip &trip) const { return this->sort_time_(trip.arrival_time, trip.departure_time); }
+
+    // Each source's slots are already in time order, so every stop is a
+    // merge of sorted runs cut off at trips_per_stop.
+    void merge_() {
+      this->trips.clear();
+      const size_t source_count = this->sources_.size();
+      std::vector<uint8_t> &cursors = this->merge_cursors_;
+      cursors.resize(source_count);
+
+      for (size_t stop = 0; stop < this->stop_ids_.size(); stop++) {
+        this->stop_offsets_[stop] = this->trips.size();
+        std::fill(cursors.begin(), cursors.end(), 0);
+
+        for (size_t taken = 0; taken < this->trips_per_stop_; taken++) {
+          const Trip *next = nullptr;
+          size_t next_source = 0;
+          for (size_t i = 0; i < source_count; i++) {
+            const SourceGeneration &source = *this->sources_[i];
+            if (cursors[i] >= source.counts[stop]) {
+              continue;
+            }
+            const Trip &candidate = source.slots[stop * this->trips_per_stop_ + cursors[i]];
+            if (next == nullptr || this->sort_time_(candidate) < this->sort_time_(*next)) {
+              next = &candidate;
+              next_source = i;
+            }
+          }
+
+          if (next == nullptr) {
+            break;
+          }
+          this->trips.push_back(*next);
+          cursors[next_source]++;
+        }
+      }
+      this->stop_offsets_[this->stop_ids_.size()] = this->trips.size();
+    }
+
+    std::vector<std::unique_ptr<SourceGeneration>> sources_;
+    std::vector<std::string> stop_ids_;
+    // Start of each stop's trips in `trips`, plus the end of the last
+    std::vector<size_t> stop_offsets_;
+    std::vector<uint8_t> merge_cursors_;
+    size_t trips_per_stop_ = 1;
+    SourceGeneration *building_ = nullptr;
+    uint8_t building_index_ = 0;
 };
 
 } // namespace transit_tracker
@@ -0,0 +1,87 @@
+import esphome.codegen as cg
+import esphome.config_validation as cv
+from esphome.components import sensor
+from esphome.const import (
+    CONF_UPDATE_INTERVAL,
+    ENTITY_CATEGORY_DIAGNOSTIC,
+    ICON_COUNTER,
+    STATE_CLASS_MEASUREMENT,
+    STATE_CLASS_TOTAL_INCREASING,
+    UNIT_BYTES,
+    UNIT_MILLISECOND,
+)
+
+from . import TransitTracker
+
+DEPENDENCIES = ["transit_tracker"]
+
+CONF_TRANSIT_TRACKER_ID = "transit_tracker_id"
+
+ICON_MEMORY = "mdi:memory"
+ICON_TIMER = "mdi:timer-outline"
+
+CONF_RENDER_LATENCY = "render_latency"
+
+MEMORY_SENSORS = [
+    "heap_free",
+    "heap_min_free",
+    "heap_largest_block",
+    "psram_free",
+    "psram_min_free",
+    "psram_largest_block",
+    "json_document_peak",
+]
+
+ALLOCATION_SENSORS = [
+    "parse_allocations",
+    "render_allocations",
+    "tls_allocations",
+]
+
+CONFIG_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(CONF_TRANSIT_TRACKER_ID): cv.use_id(TransitTracker),
+        cv.Optional(CONF_UPDATE_INTERVAL, default="60s"): cv.update_interval,
+        **{
+            cv.Optional(key): sensor.sensor_schema(
+                unit_of_measurement=UNIT_BYTES,
+                icon=ICON_MEMORY,
+                accuracy_decimals=0,
+                state_class=STATE_CLASS_MEASUREMENT,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            )
+            for key in MEMORY_SENSORS
+        },
+        **{
+            cv.Optional(key): sensor.sensor_schema(
+                icon=ICON_COUNTER,
+                accuracy_decimals=0,
+                state_class=STATE_CLASS_TOTAL_INCREASING,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            )
+            for key in ALLOCATION_SENSORS
+        },
+        cv.Optional(CONF_RENDER_LATENCY): sensor.sensor_schema(
+            unit_of_measurement=UNIT_MILLISECOND,
+            icon=ICON_TIMER,
+            accuracy_decimals=0,
+            state_class=STATE_CLASS_MEASUREMENT,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
+    }
+)
+
+
+async def to_code(config):
+    tracker = await cg.get_variable(config[CONF_TRANSIT_TRACKER_ID])
+    cg.add(tracker.set_memory_update_interval(config[CONF_UPDATE_INTERVAL]))
+
+    # Counting C++ heap allocations replaces the global operator new, so it is
+    # only compiled in when someone is looking at the counts
+    if any(key in config for key in ALLOCATION_SENSORS):
+        cg.add_define("USE_TRANSIT_TRACKER_ALLOC_TRACKING")
+
+    for key in MEMORY_SENSORS + ALLOCATION_SENSORS + [CONF_RENDER_LATENCY]:
+        if key in config:
+            sens = await sensor.new_sensor(config[key])
+            cg.add(getattr(tracker, f"set_{key}_sensor")(sens))
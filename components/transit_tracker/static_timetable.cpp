@@ -0,0 +1,115 @@
+#include "static_timetable.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace esphome {
+namespace transit_tracker {
+
+static bool read_varint(const uint8_t *data, size_t size, size_t &offset, uint32_t &value) {
+  value = 0;
+  for (int shift = 0; shift < 32; shift += 7) {
+    if (offset >= size) {
+      return false;
+    }
+    uint8_t byte = data[offset++];
+    value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool read_string(const uint8_t *data, size_t size, size_t &offset, const char *&str, size_t &length) {
+  uint32_t prefix;
+  if (!read_varint(data, size, offset, prefix) || prefix > size - offset) {
+    return false;
+  }
+  str = reinterpret_cast<const char *>(data + offset);
+  length = prefix;
+  offset += prefix;
+  return true;
+}
+
+void StaticTimetable::write_varint_(uint32_t value) {
+  while (value >= 0x80) {
+    this->data_.push_back(static_cast<uint8_t>(value) | 0x80);
+    value >>= 7;
+  }
+  this->data_.push_back(static_cast<uint8_t>(value));
+}
+
+void StaticTimetable::write_string_(const std::string &str) {
+  this->write_varint_(str.size());
+  this->data_.insert(this->data_.end(), str.begin(), str.end());
+}
+
+void StaticTimetable::add_entry(const std::string &stop_id, const std::string &route_id, const std::string &route_name,
+                                const std::string &headsign, uint8_t days, std::vector<uint16_t> departures) {
+  std::sort(departures.begin(), departures.end());
+
+  this->write_string_(stop_id);
+  this->write_string_(route_id);
+  this->write_string_(route_name);
+  this->write_string_(headsign);
+  this->data_.push_back(days);
+  this->write_varint_(departures.size());
+
+  uint16_t previous = 0;
+  for (uint16_t minutes : departures) {
+    this->write_varint_(minutes - previous);
+    previous = minutes;
+  }
+}
+
+void StaticTimetable::for_each_entry(const std::function<void(const TimetableEntry &)> &callback) const {
+  const uint8_t *data = this->data_.data();
+  const size_t size = this->data_.size();
+  size_t offset = 0;
+
+  TimetableEntry entry;
+  while (offset < size) {
+    uint32_t count;
+    if (!read_string(data, size, offset, entry.stop_id, entry.stop_id_length) ||
+        !read_string(data, size, offset, entry.route_id, entry.route_id_length) ||
+        !read_string(data, size, offset, entry.route_name, entry.route_name_length) ||
+        !read_string(data, size, offset, entry.headsign, entry.headsign_length) ||
+        offset >= size) {
+      return;
+    }
+
+    entry.days = data[offset++];
+    if (!read_varint(data, size, offset, count)) {
+      return;
+    }
+
+    entry.departures.clear();
+    uint32_t minutes = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t delta;
+      if (!read_varint(data, size, offset, delta)) {
+        return;
+      }
+      minutes += delta;
+      entry.departures.push_back(minutes);
+    }
+
+    callback(entry);
+  }
+}
+
+int parse_time_of_day(const char *str) {
+  int hours, minutes;
+  if (str == nullptr || sscanf(str, "%d:%d", &hours, &minutes) != 2) {
+    return -1;
+  }
+  // Hours past 24 are allowed for service running past midnight
+  if (hours < 0 || hours > 47 || minutes < 0 || minutes > 59) {
+    return -1;
+  }
+  return hours * 60 + minutes;
+}
+
+}  // namespace transit_tracker
+}  // namespace esphome
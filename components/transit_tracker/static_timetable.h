@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace esphome {
+namespace transit_tracker {
+
+// One route's fixed departures at one stop, as decoded from a timetable.
+struct TimetableEntry {
+  const char *stop_id;
+  size_t stop_id_length;
+  const char *route_id;
+  size_t route_id_length;
+  const char *route_name;
+  size_t route_name_length;
+  const char *headsign;
+  size_t headsign_length;
+  // Bit 0 = Monday ... bit 6 = Sunday
+  uint8_t days;
+  // Departure times in minutes after local midnight, ascending
+  std::vector<uint16_t> departures;
+};
+
+// A compact static timetable used to project departures while no live data
+// is available. Entries are stored back to back as length-prefixed strings
+// followed by delta-encoded departure minutes in LEB128 varints, so a
+// route with departures every few minutes costs about one byte per trip.
+class StaticTimetable {
+  public:
+    static const uint8_t ALL_DAYS = 0x7F;
+
+    void clear() { data_.clear(); }
+    bool empty() const { return data_.empty(); }
+
+    void add_entry(const std::string &stop_id, const std::string &route_id, const std::string &route_name,
+                   const std::string &headsign, uint8_t days, std::vector<uint16_t> departures);
+    void for_each_entry(const std::function<void(const TimetableEntry &)> &callback) const;
+
+    const std::vector<uint8_t> &data() const { return data_; }
+    void set_data(const uint8_t *data, size_t length) { data_.assign(data, data + length); }
+
+  protected:
+    void write_varint_(uint32_t value);
+    void write_string_(const std::string &str);
+
+    std::vector<uint8_t> data_;
+};
+
+// Parses "HH:MM" into minutes after midnight; returns -1 if malformed.
+int parse_time_of_day(const char *str);
+
+}  // namespace transit_tracker
+}  // namespace esphome
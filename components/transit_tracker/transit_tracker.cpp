@@ -1,8 +1,11 @@
 #include "transit_tracker.h"
+#include "persistence.h"
+#include "static_timetable.h"
 #include "string_utils.h"
 
 #include "esphome/core/log.h"
 #include "esphome/core/application.h"
+#include "esphome/core/helpers.h"
 #include "esphome/components/json/json_util.h"
 #include "esphome/components/watchdog/watchdog.h"
 #include "esphome/components/network/util.h"
@@ -13,27 +16,33 @@ extern "C" {
 }
 
 #include "mbedtls/platform.h"
+#include <algorithm>
+#include <memory>
 #include <string.h>
 #include "Arduino.h"
 
-static void *psram_calloc(size_t n, size_t size) {
+static void *tls_calloc(size_t n, size_t size) {
+  static const uint32_t caps = ESP.getPsramSize() > 0 ? MALLOC_CAP_SPIRAM : MALLOC_CAP_DEFAULT;
   size_t total_size = n * size;
-  void *ptr = heap_caps_malloc(total_size, MALLOC_CAP_SPIRAM);
+  void *ptr = heap_caps_malloc(total_size, caps);
   if (ptr != nullptr) {
     memset(ptr, 0, total_size);
+    esphome::transit_tracker::MemoryTelemetry::record_alloc(esphome::transit_tracker::ALLOC_CATEGORY_TLS);
   }
   return ptr;
 }
 
-static void psram_free(void *ptr) {
+static void tls_free(void *ptr) {
   heap_caps_free(ptr);
 }
 
 static void override_mbedtls_allocators() {
   static bool done = false;
   if (!done) {
+    // Always route mbedTLS through our allocators so TLS allocations are
+    // counted, even when they stay on the default heap.
+    mbedtls_platform_set_calloc_free(tls_calloc, tls_free);
     if (ESP.getPsramSize() > 0) {
-      mbedtls_platform_set_calloc_free(psram_calloc, psram_free);
       ets_printf("[mbedTLS] Allocators set to PSRAM.\n");
     } else {
       ets_printf("[mbedTLS] PSRAM not found. Using default heap.\n");
@@ -42,47 +51,132 @@ static void override_mbedtls_allocators() {
   }
 }
 
-namespace memstats {
-
-inline void log_memory_stats(const char *tag = "mem") {
-    ESP_LOGD("mem", "Total heap: %d", ESP.getHeapSize());
-    ESP_LOGD("mem", "Free heap: %d", ESP.getFreeHeap());
-    ESP_LOGD("mem", "Total PSRAM: %d", ESP.getPsramSize());
-    ESP_LOGD("mem", "Free PSRAM: %d", ESP.getFreePsram());
-}
-
-} // namespace memstats
-
 namespace esphome {
 namespace transit_tracker {
 
 static const char *TAG = "transit_tracker.component";
 
+// Adjust based on max outbound size
+static const size_t SUBSCRIBE_JSON_CAPACITY = 4 * 1024;
+// Messages are handled one at a time, so the inbound schedule document and
+// the (rarely rebuilt) outbound subscribe document share one arena, which
+// all tracker instances share as well. This is only the initial size: the
+// arena grows to fit larger frames, up to the document limit.
+static const size_t PARSE_ARENA_SIZE = 2 * SUBSCRIBE_JSON_CAPACITY;
+#ifdef USE_TRANSIT_TRACKER_LOW_MEMORY
+// Initial size of each trip string arena; overflow spills into extra blocks.
+static const size_t TRIP_ARENA_SIZE = 1024;
+// Trips kept per stop beyond what the display shows, to cover the ones that
+// depart between schedule updates
+static const size_t TRIP_HEADROOM = 1;
+// Rough internal heap taken by one TLS session, for the budget report
+static const size_t TLS_SESSION_ESTIMATE = 40 * 1024;
+#else
+// Initial size of each trip string arena; overflow spills into extra blocks.
+static const size_t TRIP_ARENA_SIZE = 4 * 1024;
+static const size_t TRIP_HEADROOM = 2;
+#endif
+// Failed connection attempts after which a feed is considered down
+static const int FAILED_SOURCE_ATTEMPTS = 3;
+// Failed connection attempts of every feed after which the board reboots
+static const int REBOOT_ATTEMPTS = 15;
+// Connect and read timeout for each remote config request
+static const uint32_t CONFIG_FETCH_TIMEOUT_MS = 10000;
+// Minimum time between schedule snapshot writes, to limit flash wear
+static const uint32_t SCHEDULE_SNAPSHOT_INTERVAL_MS = 15 * 60 * 1000;
+
+// Large buffers go to PSRAM when the board has it, and always stay on the
+// internal heap in low-memory mode
+static uint32_t large_buffer_caps() {
+#ifdef USE_TRANSIT_TRACKER_LOW_MEMORY
+  return MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+#else
+  return ESP.getPsramSize() > 0 ? MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT : MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+#endif
+}
+
 void TransitTracker::setup() {
   override_mbedtls_allocators();
-  update_schedule_string_from_remote_config();
-  
-  this->ws_client_.onMessage([this](websockets::WebsocketsMessage message) {
-    this->on_ws_message_(message);
-  });
 
-  this->ws_client_.onEvent([this](websockets::WebsocketsEvent event, String data) {
-    this->on_ws_event_(event, data);
-  });
+  Arena &parse_arena = FeedConnection::parse_arena();
+  if (!parse_arena.is_initialized() &&
+      !parse_arena.init(PARSE_ARENA_SIZE, large_buffer_caps(), ALLOC_CATEGORY_PARSE)) {
+    ESP_LOGE(TAG, "Failed to allocate %u byte parse arena", PARSE_ARENA_SIZE);
+  }
 
-  this->connect_ws_();
+  // The top-level base URL and feed code form the primary source; any
+  // additional feeds follow it
+  if (!this->base_url_.empty()) {
+    std::unique_ptr<FeedSource> primary(new FeedSource());
+    primary->base_url = this->base_url_;
+    primary->feed_code = this->feed_code_;
+    this->sources_.insert(this->sources_.begin(), std::move(primary));
+  }
+
+  FeedConnection::raise_document_limit(this->json_document_limit_);
+
+  // The capture is device-wide; the first instance that asks for one sets it up
+  FrameCapture &frame_capture = FeedConnection::frame_capture();
+  if (this->frame_capture_frames_ > 0 && !frame_capture.is_enabled() &&
+      !frame_capture.init(this->frame_capture_frames_, this->frame_capture_buffer_size_)) {
+    ESP_LOGE(TAG, "Failed to allocate %u byte frame capture buffer in PSRAM", this->frame_capture_buffer_size_);
+  }
+
+  // If enabled, sources on the same server share one connection and
+  // subscribe side by side
+  for (size_t i = 0; i < this->sources_.size(); i++) {
+    FeedSource &source = *this->sources_[i];
+    source.connection = FeedConnection::get(source.base_url, this->share_connection_);
+    source.subscription_id = source.connection->subscribe(
+      [this, i](JsonObject root) {
+        this->on_ws_message_(i, root);
+      },
+      [this, i](websockets::WebsocketsEvent event) {
+        this->on_ws_event_(i, event);
+      });
+  }
+
+  // Without a trip arena for every source there is nowhere to put a
+  // schedule; the component stays failed and ignores anything it receives
+  if (!this->schedule_state_.init(this->sources_.size(), TRIP_ARENA_SIZE, large_buffer_caps())) {
+    ESP_LOGE(TAG, "Failed to allocate %u byte trip arenas", TRIP_ARENA_SIZE);
+    this->mark_failed();
+    return;
+  }
+  this->schedule_state_.sort_by_departure = this->display_departure_times_;
+
+  // With a config URL, the websocket connects once a config is known so the
+  // first subscribe carries the stops: immediately if one was persisted by a
+  // previous boot (the fetch then only reconciles it), otherwise once it has
+  // been fetched in the background.
+  if (this->config_url_.empty()) {
+    ESP_LOGE(TAG, "Missing config URL");
+    this->connect_ws_();
+  } else {
+    uint32_t pref_key = fnv1_hash("transit_tracker" + this->config_url_);
+    this->config_pref_ = global_preferences->make_preference<PersistedBlob<PERSISTED_CONFIG_SIZE>>(pref_key, true);
+    this->schedule_pref_ = global_preferences->make_preference<PersistedBlob<PERSISTED_SCHEDULE_SIZE>>(pref_key + 1, true);
+    this->timetable_pref_ = global_preferences->make_preference<PersistedBlob<PERSISTED_TIMETABLE_SIZE>>(pref_key + 2, true);
+
+    if (this->restore_config_()) {
+      this->restore_schedule_();
+      this->connect_ws_();
+    }
+
+    this->update_schedule_string_from_remote_config();
+  }
 
   this->set_interval("check_stale_trips", 10000, [this]() {
-    if (this->ws_client_.available() && !this->schedule_state_.trips.empty()) {
-      bool has_stale_trips = false;
+    if (this->any_source_connected_() && !this->schedule_state_.trips.empty()) {
+      int stale_source = -1;
 
       this->schedule_state_.mutex.lock();
 
       auto now = this->rtc_->now();
-      if (now.is_valid()) {
+      if (now.is_valid() && !this->schedule_state_.is_stale) {
         for (auto &trip : this->schedule_state_.trips) {
           if (now.timestamp - trip.departure_time > 60) {
-            has_stale_trips = true;
+            stale_source = trip.source;
             break;
           }
         }
@@ -90,35 +184,203 @@ void TransitTracker::setup() {
 
       this->schedule_state_.mutex.unlock();
 
-      if (has_stale_trips) {
-        ESP_LOGD(TAG, "Stale trips detected, reconnecting");
+      if (stale_source >= 0 && static_cast<size_t>(stale_source) < this->sources_.size()) {
+        FeedSource &source = *this->sources_[stale_source];
+        ESP_LOGD(TAG, "Stale trips detected, reconnecting %s", source.base_url.c_str());
         ESP_LOGD(TAG, "  Current RTC time: %d", now.timestamp);
-        ESP_LOGD(TAG, "  Last heartbeat: %d", this->last_heartbeat_);
-        this->reconnect();
+        ESP_LOGD(TAG, "  Last heartbeat: %d", source.connection->last_heartbeat);
+        source.connection->client().close();
+        this->connect_source_(stale_source);
       }
     }
   });
+
+  // While the websocket is down, keep the board useful by projecting the
+  // next departures from the static timetable, if the config has one
+  this->set_interval("offline_schedule", 30000, [this]() {
+    if (!this->any_source_connected_() && !this->timetable_.empty()) {
+      this->project_offline_schedule_();
+    }
+  });
+
+  this->update_memory_telemetry_();
+  this->set_interval("memory_telemetry", this->memory_update_interval_, [this]() {
+    this->update_memory_telemetry_();
+  });
 }
 
 void TransitTracker::loop() {
-  this->ws_client_.poll();
+  ConfigFetchResult config_result;
+  if (this->config_fetcher_.poll(config_result)) {
+    if (!config_result.error.empty()) {
+      ESP_LOGE(TAG, "%s", config_result.error.c_str());
+    }
+    this->on_remote_config_fetched_(config_result);
+  }
 
-  if (this->last_heartbeat_ != 0 && millis() - this->last_heartbeat_ > 60000) {
-    ESP_LOGW(TAG, "Heartbeat timeout, reconnecting");
-    this->reconnect();
-    return;
+  // One pass over all sources: polling a connection with nothing pending is
+  // cheap, so extra sources add little per-loop cost
+  for (size_t i = 0; i < this->sources_.size(); i++) {
+    FeedSource &source = *this->sources_[i];
+    source.connection->poll(source.subscription_id);
+
+    if (source.connection->last_heartbeat != 0 && millis() - source.connection->last_heartbeat > 60000) {
+      ESP_LOGW(TAG, "Heartbeat timeout, reconnecting %s", source.base_url.c_str());
+      source.connection->client().close();
+      this->connect_source_(i);
+    }
   }
 }
 
 void TransitTracker::dump_config() {
   ESP_LOGCONFIG(TAG, "Transit Tracker:");
-  ESP_LOGCONFIG(TAG, "  Base URL: %s", this->base_url_.c_str());
-  ESP_LOGCONFIG(TAG, "  Schedule: %s", this->schedule_string_.c_str());
+  for (const auto &source : this->sources_) {
+    ESP_LOGCONFIG(TAG, "  Feed source: %s", source->base_url.c_str());
+    if (!source->feed_code.empty()) {
+      ESP_LOGCONFIG(TAG, "    Feed code: %s", source->feed_code.c_str());
+    }
+    ESP_LOGCONFIG(TAG, "    Schedule: %s", source->schedule_string.c_str());
+    if (source->connection != nullptr && source->connection->subscriber_count() > 1) {
+      ESP_LOGCONFIG(TAG, "    Shared connection: subscription %u of %u", source->subscription_id,
+                    source->connection->subscriber_count());
+    }
+  }
   ESP_LOGCONFIG(TAG, "  Limit: %d", this->limit_);
   ESP_LOGCONFIG(TAG, "  List mode: %s", this->list_mode_.c_str());
   ESP_LOGCONFIG(TAG, "  Display departure times: %s", this->display_departure_times_ ? "true" : "false");
   ESP_LOGCONFIG(TAG, "  Unit display: %s", this->unit_display_ == UNIT_DISPLAY_LONG ? "long" : this->unit_display_ == UNIT_DISPLAY_SHORT ? "short" : "none");
-  memstats::log_memory_stats();
+  ESP_LOGCONFIG(TAG, "  JSON document limit: %u bytes", FeedConnection::document_limit());
+  ESP_LOGCONFIG(TAG, "  Trips kept per stop: %u", this->trips_per_stop_());
+#ifdef USE_TRANSIT_TRACKER_LOW_MEMORY
+  // Each source keeps a live and a pending trip arena
+  const size_t trip_budget = 2 * std::max<size_t>(this->sources_.size(), 1) * TRIP_ARENA_SIZE;
+  const size_t tls_budget = TLS_SESSION_ESTIMATE * this->sources_.size();
+  ESP_LOGCONFIG(TAG, "  Low-memory mode");
+  ESP_LOGCONFIG(TAG, "    Heap budget: %u bytes (parse %u, trips %u, TLS ~%u)",
+                FeedConnection::document_limit() + trip_budget + tls_budget, FeedConnection::document_limit(),
+                trip_budget, tls_budget);
+  ESP_LOGCONFIG(TAG, "    Internal heap free: %u bytes", heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+#endif
+  if (this->frame_capture_frames_ > 0) {
+    ESP_LOGCONFIG(TAG, "  Frame capture: last %u frames, %u byte buffer", this->frame_capture_frames_,
+                  this->frame_capture_buffer_size_);
+  }
+  this->memory_telemetry_.log(TAG);
+}
+
+void TransitTracker::update_memory_telemetry_() {
+  this->memory_telemetry_.sample();
+
+  const HeapStats &internal = this->memory_telemetry_.get_internal();
+  const HeapStats &psram = this->memory_telemetry_.get_psram();
+
+  ESP_LOGV(TAG, "Heap: free=%u min=%u largest=%u; PSRAM: free=%u min=%u largest=%u",
+           internal.free, internal.min_free, internal.largest_free_block,
+           psram.free, psram.min_free, psram.largest_free_block);
+
+#ifdef USE_SENSOR
+  if (this->heap_free_sensor_ != nullptr)
+    this->heap_free_sensor_->publish_state(internal.free);
+  if (this->heap_min_free_sensor_ != nullptr)
+    this->heap_min_free_sensor_->publish_state(internal.min_free);
+  if (this->heap_largest_block_sensor_ != nullptr)
+    this->heap_largest_block_sensor_->publish_state(internal.largest_free_block);
+  if (this->psram_free_sensor_ != nullptr)
+    this->psram_free_sensor_->publish_state(psram.free);
+  if (this->psram_min_free_sensor_ != nullptr)
+    this->psram_min_free_sensor_->publish_state(psram.min_free);
+  if (this->psram_largest_block_sensor_ != nullptr)
+    this->psram_largest_block_sensor_->publish_state(psram.largest_free_block);
+  if (this->parse_allocations_sensor_ != nullptr)
+    this->parse_allocations_sensor_->publish_state(MemoryTelemetry::get_alloc_count(ALLOC_CATEGORY_PARSE));
+  if (this->render_allocations_sensor_ != nullptr)
+    this->render_allocations_sensor_->publish_state(MemoryTelemetry::get_alloc_count(ALLOC_CATEGORY_RENDER));
+  if (this->tls_allocations_sensor_ != nullptr)
+    this->tls_allocations_sensor_->publish_state(MemoryTelemetry::get_alloc_count(ALLOC_CATEGORY_TLS));
+  if (this->json_document_peak_sensor_ != nullptr)
+    this->json_document_peak_sensor_->publish_state(FeedConnection::document_high_water());
+  if (this->render_latency_sensor_ != nullptr && this->max_render_latency_us_ != 0)
+    this->render_latency_sensor_->publish_state(this->max_render_latency_us_ / 1000.0f);
+#endif
+  this->max_render_latency_us_ = 0;
+}
+
+void TransitTracker::dump_frame_capture() {
+  FeedConnection::frame_capture().dump(TAG);
+}
+
+bool TransitTracker::replaying_ = false;
+
+void TransitTracker::replay_frame_capture() {
+  FrameCapture &frame_capture = FeedConnection::frame_capture();
+  if (frame_capture.size() == 0) {
+    ESP_LOGI(TAG, "No captured frames to replay");
+    return;
+  }
+
+  ESP_LOGI(TAG, "Replaying %u captured frames:", frame_capture.size());
+
+  // Frames are parsed in place, so each is copied out of the capture first
+  std::string frame;
+  uint32_t total_parse_us = 0, max_parse_us = 0;
+  uint32_t total_render_us = 0, max_render_us = 0;
+  uint32_t previous_received_at = 0;
+  size_t replayed = 0;
+
+  replaying_ = true;
+  frame_capture.for_each([&](const CapturedFrame &captured) {
+    if (captured.length < captured.original_length) {
+      ESP_LOGI(TAG, "  Frame #%u: skipped, only %u of %u bytes were captured", captured.sequence, captured.length,
+               captured.original_length);
+      return;
+    }
+
+    frame.assign(captured.data, captured.length);
+    auto *connection = static_cast<FeedConnection *>(const_cast<void *>(captured.source));
+
+    // A replayed heartbeat says nothing about the live connection
+    const long last_heartbeat = connection->last_heartbeat;
+    uint32_t start = micros();
+    connection->dispatch(&frame[0], frame.size());
+    uint32_t parse_us = micros() - start;
+    connection->last_heartbeat = last_heartbeat;
+    const RenderStats &render = this->probe_render_();
+    uint32_t render_us = render.duration_us;
+
+    ESP_LOGI(TAG, "  Frame #%u (+%ums, %u bytes): parse %uus, render %uus, %u pixels, hash %08x", captured.sequence,
+             replayed > 0 ? captured.received_at - previous_received_at : 0, captured.length, parse_us, render_us,
+             render.pixels, render.hash);
+
+    total_parse_us += parse_us;
+    max_parse_us = std::max(max_parse_us, parse_us);
+    total_render_us += render_us;
+    max_render_us = std::max(max_render_us, render_us);
+    previous_received_at = captured.received_at;
+    replayed++;
+  });
+  replaying_ = false;
+
+  if (replayed == 0) {
+    return;
+  }
+  ESP_LOGI(TAG, "  Parse:  avg %uus, max %uus", total_parse_us / replayed, max_parse_us);
+  ESP_LOGI(TAG, "  Render: avg %uus, max %uus", total_render_us / replayed, max_render_us);
+}
+
+void TransitTracker::measure_render() {
+  const RenderStats &stats = this->probe_render_();
+  ESP_LOGI(TAG, "Render: %u pixels, %u clipped, hash %08x, %uus", stats.pixels, stats.clipped_pixels, stats.hash,
+           stats.duration_us);
+}
+
+const RenderStats &TransitTracker::probe_render_() {
+  display::Display *display = this->display_;
+  this->render_probe_.begin(display);
+  this->display_ = &this->render_probe_;
+  this->draw_current_page();
+  this->display_ = display;
+  this->render_probe_.end();
+  return this->render_probe_.stats();
 }
 
 void TransitTracker::reconnect() {
@@ -131,7 +393,9 @@ void TransitTracker::close(bool fully) {
     this->fully_closed_ = true;
   }
 
-  this->ws_client_.close();
+  for (auto &source : this->sources_) {
+    source->connection->client().close();
+  }
 }
 
 void TransitTracker::on_shutdown() {
@@ -139,152 +403,158 @@ void TransitTracker::on_shutdown() {
   this->close(true);
 }
 
-void TransitTracker::on_ws_message_(websockets::WebsocketsMessage message) {
-  ESP_LOGV(TAG, "Received message: %s", message.rawData().c_str());
-    
-  // Tune to your payload ceiling (bytes). Keep headroom for parsing overhead.
-   constexpr size_t JSON_CAP = 48 * 1024;
-  
-  // --- Allocate the JSON document in PSRAM so the internal pool lives there ---
-  void* doc_mem = heap_caps_malloc(sizeof(StaticJsonDocument<JSON_CAP>),
-                                   MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-  if (!doc_mem) {
-    this->status_set_error("No PSRAM for JSON doc");
+void TransitTracker::on_ws_message_(size_t source_index, JsonObject root) {
+  // A shared connection is still polled by the other trackers on it
+  if (this->is_failed()) {
     return;
   }
-  auto* doc = new (doc_mem) StaticJsonDocument<JSON_CAP>();
 
-  auto cleanup_doc = [&](){
-    doc->~StaticJsonDocument();
-    heap_caps_free(doc_mem);
-  };
-
-  DeserializationError err = deserializeJson(*doc, message.rawData());
-  if (err) {
-    cleanup_doc();
-    this->status_set_error("Failed to parse schedule data");
+  // Replayed frames leave the live connection's status alone
+  if (root.isNull()) {
+    if (!replaying_) {
+      this->status_set_error("Failed to parse schedule data");
+    }
     return;
   }
 
-  JsonObject root = doc->as<JsonObject>();
   const char* event = root["event"] | "";
-
-  if (strcmp(event, "heartbeat") == 0) {
-    ESP_LOGD(TAG, "Received heartbeat");
-    this->last_heartbeat_ = millis();
-    cleanup_doc();
-    return;
-  }
-
   if (strcmp(event, "schedule") != 0) {
-    ESP_LOGD("JSON", "Received message: %s", message.rawData().c_str());
-    this->status_set_error("Failed to parse schedule data");
-    cleanup_doc();
+    ESP_LOGD(TAG, "Received unexpected event: %s", event);
+    if (!replaying_) {
+      this->status_set_error("Failed to parse schedule data");
+    }
     return;
   }
 
   ESP_LOGD(TAG, "Received schedule update");
 
-  this->schedule_state_.mutex.lock();
-  this->schedule_state_.trips.clear();
-
   JsonObject data = root["data"];
   JsonArray trips = data["trips"].as<JsonArray>();
 
-  for (JsonObject trip : trips) {
-    std::string headsign = trip["headsign"].as<const char*>();
+  this->schedule_state_.begin_generation(source_index);
 
-    for (const auto &abbr : this->abbreviations_) {
-      size_t pos = headsign.find(abbr.first);
-      if (pos != std::string::npos) {
-        ESP_LOGV(TAG, "Applying abbreviation '%s' -> '%s' in headsign",
-                 abbr.first.c_str(), abbr.second.c_str());
-        headsign.replace(pos, abbr.first.length(), abbr.second);
-      }
+  for (JsonObject trip : trips) {
+    // Trips for other stops, or later than the ones a stop already holds,
+    // are dropped on sight. The rest borrow their strings from the frame
+    // until the generation is final.
+    const char *trip_stop_id = trip["stopId"] | "";
+    const int stop = this->schedule_state_.find_stop(trip_stop_id);
+    const time_t arrival_time = trip["arrivalTime"].as<time_t>();
+    const time_t departure_time = trip["departureTime"].as<time_t>();
+    if (!this->schedule_state_.accepts(stop, arrival_time, departure_time)) {
+      continue;
     }
 
-    std::string stop_id   = trip["stopId"].as<const char*>();
-    std::string route_id  = trip["routeId"].as<const char*>();
-    std::string route_name = trip["routeName"].as<const char*>();
-
+    const char *route_id = trip["routeId"] | "";
+    const char *route_name = trip["routeName"] | "";
     Color route_color = this->default_route_color_;
 
-    auto route_style = this->route_styles_.find(route_id);
-    if (route_style != this->route_styles_.end()) {
-      route_color = route_style->second.color;
-      route_name  = route_style->second.name;
+    const char *style_name;
+    if (this->find_route_style_(route_id, strlen(route_id), &style_name, &route_color)) {
+      route_name = style_name;
     } else if (!trip["routeColor"].isNull()) {
       route_color = Color(std::stoul(trip["routeColor"].as<const char*>(), nullptr, 16));
     }
 
-    this->schedule_state_.trips.push_back({
-      .stop_id        = std::move(stop_id),
-      .route_id       = std::move(route_id),
-      .route_name     = std::move(route_name),
+    Trip new_trip{
+      .stop_id        = StringRef(trip_stop_id),
+      .route_id       = StringRef(route_id),
+      .route_name     = StringRef(route_name),
       .route_color    = route_color,
-      .headsign       = std::move(headsign),
-      .arrival_time   = trip["arrivalTime"].as<time_t>(),
-      .departure_time = trip["departureTime"].as<time_t>(),
+      .headsign       = StringRef(trip["headsign"] | ""),
+      .arrival_time   = arrival_time,
+      .departure_time = departure_time,
       .is_realtime    = trip["isRealtime"].as<bool>(),
-    });
+    };
+    this->schedule_state_.add(stop, new_trip);
   }
 
-  this->schedule_state_.mutex.unlock();
+  // Only trips that made their stop's cut get strings in the trip arena, so
+  // it holds at most stops x K trips in whatever order they arrived
+  this->schedule_state_.for_each_pending([this](Trip &trip) {
+    std::string &headsign = this->headsign_scratch_;
+    headsign.assign(trip.headsign.c_str(), trip.headsign.size());
+    this->apply_abbreviations_(headsign);
+
+    trip.stop_id = this->schedule_state_.store(trip.stop_id.c_str(), trip.stop_id.size());
+    trip.route_id = this->schedule_state_.store(trip.route_id.c_str(), trip.route_id.size());
+    trip.route_name = this->schedule_state_.store(trip.route_name.c_str(), trip.route_name.size());
+    trip.headsign = this->schedule_state_.store(headsign);
+    this->prepare_trip_(trip, false);
+  });
 
-  cleanup_doc();
-}
+  size_t trip_count = this->schedule_state_.pending_size();
+  this->schedule_state_.commit_generation();
+  ESP_LOGV(TAG, "Schedule generation: %u trips, %u bytes", trip_count, this->schedule_state_.generation_bytes());
 
-void TransitTracker::on_ws_event_(websockets::WebsocketsEvent event, String data) {
-  if (event == websockets::WebsocketsEvent::ConnectionOpened) {
-    ESP_LOGD(TAG, "WebSocket connection opened");
-
-    constexpr size_t JSON_CAP = 4 * 1024; // Adjust based on max outbound size
+  // Latency is measured from the oldest update not yet on screen. Replayed
+  // frames are only rendered off-panel, and their connection's receive
+  // time belongs to the last live frame.
+  if (this->render_pending_since_us_ == 0 && !replaying_) {
+    this->render_pending_since_us_ = std::max<uint32_t>(this->sources_[source_index]->connection->received_at_us, 1);
+  }
 
-    // --- Allocate StaticJsonDocument in PSRAM ---
-    void* doc_mem = heap_caps_malloc(sizeof(StaticJsonDocument<JSON_CAP>),
-                                     MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!doc_mem) {
-      ESP_LOGE(TAG, "Failed to allocate PSRAM for outbound JSON");
-      return;
-    }
+  this->persist_schedule_();
+}
 
-    auto* doc = new (doc_mem) StaticJsonDocument<JSON_CAP>();
+void TransitTracker::build_subscribe_message_(FeedSource &source) {
+  Arena &arena = FeedConnection::parse_arena();
+  arena.reset();
+  BasicJsonDocument<ArenaAllocator> doc(SUBSCRIBE_JSON_CAPACITY, ArenaAllocator(&arena));
+  if (doc.capacity() == 0) {
+    ESP_LOGE(TAG, "Failed to allocate PSRAM for outbound JSON");
+    return;
+  }
 
-    // Helper to free PSRAM safely
-    auto cleanup_doc = [&]() {
-      doc->~StaticJsonDocument();
-      heap_caps_free(doc_mem);
-    };
+  JsonObject root = doc.to<JsonObject>();
+  root["event"] = "schedule:subscribe";
 
-    // --- Build JSON ---
-    JsonObject root = doc->to<JsonObject>();
-    root["event"] = "schedule:subscribe";
+  JsonObject data = root.createNestedObject("data");
 
-    JsonObject data = root.createNestedObject("data");
+  if (!source.feed_code.empty()) {
+    data["feedCode"] = source.feed_code;
+  }
 
-    if (!this->feed_code_.empty()) {
-      data["feedCode"] = this->feed_code_;
-    }
+  // Only a shared connection needs schedules tagged with their subscriber
+  if (source.connection->is_shared()) {
+    data["subscriptionId"]   = source.subscription_id;
+  }
+  data["routeStopPairs"]     = source.schedule_string;
+  data["limit"]              = this->limit_;
+  data["sortByDeparture"]    = this->display_departure_times_;
+  data["listMode"]           = this->list_mode_;
+
+  source.subscribe_message.clear();
+  source.subscribe_message.reserve(measureJson(doc));
+  serializeJson(doc, source.subscribe_message);
+}
 
-    data["routeStopPairs"]     = this->schedule_string_;
-    data["limit"]              = this->limit_;
-    data["sortByDeparture"]    = this->display_departure_times_;
-    data["listMode"]           = this->list_mode_;
+void TransitTracker::send_subscribe_(FeedSource &source) {
+  if (!source.connection->client().available()) {
+    // The subscribe goes out when the connection (re)opens
+    return;
+  }
 
-    // --- Serialize directly from PSRAM ---
-    std::string message;
-    serializeJson(*doc, message);
+  // Built once per config change; reconnects resend it verbatim
+  if (source.subscribe_message.empty()) {
+    this->build_subscribe_message_(source);
+  }
 
-    ESP_LOGV(TAG, "Sending message: %s", message.c_str());
-    this->ws_client_.send(message.c_str());
+  log_payload(ESPHOME_LOG_LEVEL_VERBOSE, TAG, "Sending message", source.subscribe_message.data(),
+              source.subscribe_message.size());
+  source.connection->client().send(source.subscribe_message.data(), source.subscribe_message.size());
+}
 
-    // --- Free PSRAM ---
-    cleanup_doc();
+void TransitTracker::on_ws_event_(size_t source_index, websockets::WebsocketsEvent event) {
+  FeedSource &source = *this->sources_[source_index];
+  if (event == websockets::WebsocketsEvent::ConnectionOpened) {
+    ESP_LOGD(TAG, "WebSocket connection opened: %s", source.base_url.c_str());
+    this->send_subscribe_(source);
   } else if (event == websockets::WebsocketsEvent::ConnectionClosed) {
-    ESP_LOGD(TAG, "WebSocket connection closed");
-    if (!this->fully_closed_ && this->connection_attempts_ == 0) {
-      this->defer([this]() {
-        this->connect_ws_();
+    ESP_LOGD(TAG, "WebSocket connection closed: %s", source.base_url.c_str());
+    if (!this->fully_closed_ && source.connection->connection_attempts == 0) {
+      this->defer([this, source_index]() {
+        this->connect_source_(source_index);
       });
     }
   } else if (event == websockets::WebsocketsEvent::GotPing) {
@@ -295,150 +565,657 @@ void TransitTracker::on_ws_event_(websockets::WebsocketsEvent event, String data
 }
 
 void TransitTracker::connect_ws_() {
-  if (this->base_url_.empty()) {
+  if (this->sources_.empty()) {
     ESP_LOGW(TAG, "No base URL set, not connecting");
     return;
   }
 
+  for (size_t i = 0; i < this->sources_.size(); i++) {
+    this->connect_source_(i);
+  }
+}
+
+void TransitTracker::connect_source_(size_t source_index) {
+  FeedSource &source = *this->sources_[source_index];
+
   if (this->fully_closed_) {
     ESP_LOGW(TAG, "Connection fully closed, not reconnecting");
     return;
   }
 
-  if (this->ws_client_.available(true)) {
+  if (source.connection->client().available(true)) {
     ESP_LOGV(TAG, "Not reconnecting, already connected");
     return;
   }
 
   watchdog::WatchdogManager wdm(20000);
 
-  this->last_heartbeat_ = 0;
+  source.connection->last_heartbeat = 0;
+  source.connection->next_attempt = 0;
 
-  ESP_LOGD(TAG, "Connecting to WebSocket server (attempt %d): %s", this->connection_attempts_, this->base_url_.c_str());
+  ESP_LOGD(TAG, "Connecting to WebSocket server (attempt %d): %s", source.connection->connection_attempts, source.base_url.c_str());
 
   bool connection_success = false;
   if (esphome::network::is_connected()) {
-    connection_success = this->ws_client_.connect(this->base_url_.c_str());
+    connection_success = source.connection->client().connect(source.base_url.c_str());
   } else {
     ESP_LOGW(TAG, "Not connected to network; skipping connection attempt");
   }
 
   if (!connection_success) {
-    this->connection_attempts_++;
+    source.connection->connection_attempts++;
 
-    if (this->connection_attempts_ >= 3) {
-      this->status_set_error("Failed to connect to WebSocket server");
+    // One unreachable feed must not take the others down with it: it only
+    // loses its own trips, and the board reboots only if no feed is reachable
+    if (source.connection->connection_attempts == FAILED_SOURCE_ATTEMPTS) {
+      ESP_LOGW(TAG, "Dropping trips of unreachable feed %s", source.base_url.c_str());
+      this->schedule_state_.clear_source(source_index);
     }
 
-    if (this->connection_attempts_ >= 15) {
-      ESP_LOGE(TAG, "Could not connect to WebSocket server within 15 attempts.");
+    if (this->all_sources_failing_(REBOOT_ATTEMPTS)) {
+      ESP_LOGE(TAG, "Could not connect to any WebSocket server within %d attempts.", REBOOT_ATTEMPTS);
       ESP_LOGE(TAG, "It's likely that the network is not truly connected; rebooting the device to try to recover.");
       App.reboot();
     }
 
-    auto timeout = std::min(15000, this->connection_attempts_ * 5000);
+    auto timeout = std::min(15000, source.connection->connection_attempts * 5000);
     ESP_LOGW(TAG, "Failed to connect, retrying in %ds", timeout / 1000);
 
-    this->set_timeout("reconnect", timeout, [this]() {
-      this->connect_ws_();
-    });
+    source.connection->next_attempt = std::max<uint32_t>(millis() + timeout, 1);
+    this->schedule_reconnect_();
   } else {
     this->has_ever_connected_ = true;
-    this->connection_attempts_ = 0;
-    this->status_clear_error();
+    source.connection->connection_attempts = 0;
   }
+
+  this->update_connection_status_();
 }
 
-void TransitTracker::update_schedule_string_from_remote_config() {
-  if (this->config_url_.empty()) {
-    ESP_LOGE(TAG, "Missing config URL");
-    return;
+void TransitTracker::schedule_reconnect_() {
+  // All sources share one backoff timer, armed for the earliest due retry
+  uint32_t now = millis();
+  uint32_t delay = UINT32_MAX;
+  for (const auto &source : this->sources_) {
+    if (source->connection->next_attempt != 0) {
+      int32_t remaining = static_cast<int32_t>(source->connection->next_attempt - now);
+      delay = std::min<uint32_t>(delay, std::max<int32_t>(remaining, 0));
+    }
   }
 
-  ESP_LOGD(TAG, "Fetching schedule from config URL: %s", this->config_url_.c_str());
+  if (delay == UINT32_MAX) {
+    this->cancel_timeout("reconnect");
+    return;
+  }
 
-  HTTPClient http;
-  http.begin(this->config_url_.c_str());
-  int httpCode = http.GET();
+  this->set_timeout("reconnect", delay, [this]() {
+    uint32_t now = millis();
+    for (size_t i = 0; i < this->sources_.size(); i++) {
+      uint32_t next_attempt = this->sources_[i]->connection->next_attempt;
+      if (next_attempt != 0 && static_cast<int32_t>(now - next_attempt) >= 0) {
+        this->connect_source_(i);
+      }
+    }
+    this->schedule_reconnect_();
+  });
+}
 
-  if (httpCode != HTTP_CODE_OK) {
-    ESP_LOGE(TAG, "Failed to fetch config JSON. HTTP code: %d", httpCode);
+void TransitTracker::update_connection_status_() {
+  if (this->all_sources_failing_(FAILED_SOURCE_ATTEMPTS)) {
+    this->status_set_error("Failed to connect to WebSocket server");
     return;
   }
 
-  std::string payload = http.getString().c_str();
-  size_t payloadHash = std::hash<std::string>{}(payload);
-  http.end();
-
-  std::string new_schedule_string;
-  std::map<std::string, std::string> new_stop_names;
-  std::vector<std::string> new_stop_ids;
-  std::string macAddress = WiFi.macAddress().c_str();
+  this->status_clear_error();
+}
 
-  bool success = json::parse_json(payload, [&new_schedule_string, &new_stop_names, &new_stop_ids, macAddress](JsonObject root) -> bool {
-    if (!root.containsKey(macAddress)) {
-      ESP_LOGE(TAG, "Tracker of MAC address '%s' not found in config JSON", macAddress);
+bool TransitTracker::all_sources_failing_(int attempts) const {
+  for (const auto &source : this->sources_) {
+    if (source->connection->connection_attempts < attempts) {
       return false;
     }
+  }
+  return !this->sources_.empty();
+}
+
+bool TransitTracker::any_source_connected_() {
+  for (auto &source : this->sources_) {
+    if (source->connection->client().available()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void TransitTracker::update_schedule_string_from_remote_config() {
+  if (this->config_url_.empty()) {
+    ESP_LOGE(TAG, "Missing config URL");
+    return;
+  }
+
+  ESP_LOGD(TAG, "Fetching schedule from config URL: %s", this->config_url_.c_str());
+  if (!this->config_fetcher_.start(this->config_url_, CONFIG_FETCH_TIMEOUT_MS, WiFi.macAddress().c_str(),
+                                   this->config_etag_, this->config_last_modified_)) {
+    if (this->config_loaded_) {
+      // No result will come back to re-arm the poll, so try again next time
+      this->poll_remote_config_changes();
+    } else {
+      this->connect_ws_();
+    }
+  }
+}
+
+bool TransitTracker::parse_remote_config_(const std::string &payload, RemoteConfig &config) {
+  // The fetcher only hands over this device's subtree of the fleet config
+  if (payload.empty()) {
+    ESP_LOGE(TAG, "Tracker of MAC address '%s' not found in config JSON", WiFi.macAddress().c_str());
+    return false;
+  }
 
-    JsonArray stops = root[macAddress]["stops"].as<JsonArray>();
+  config.schedule_strings.resize(std::max<size_t>(this->sources_.size(), 1));
+
+  AllocScope alloc_scope(ALLOC_CATEGORY_PARSE);
+  const auto &sources = this->sources_;
+  bool success = json::parse_json(payload, [&config, &sources](JsonObject root) -> bool {
+    JsonArray stops = root["stops"].as<JsonArray>();
     for (JsonObject stop : stops) {
       std::string stop_id = stop["stopId"].as<std::string>();
       std::string nickname = stop["nickname"].as<std::string>();
 
-      new_stop_ids.push_back(stop_id);
-      new_stop_names[stop_id] = nickname;
+      config.stop_ids.push_back(stop_id);
+      config.stop_names[stop_id] = nickname;
+
+      // Stops may name the feed serving them; the primary source by default
+      size_t source_index = 0;
+      const char *feed = stop["feed"] | "";
+      for (size_t i = 0; i < sources.size(); i++) {
+        if (sources[i]->feed_code == feed) {
+          source_index = i;
+          break;
+        }
+      }
 
+      std::string &schedule_string = config.schedule_strings[source_index];
       JsonArray routes = stop["routes"].as<JsonArray>();
       for (const auto &route : routes) {
-        new_schedule_string += route.as<std::string>() + "," + stop_id + ",0;";
+        schedule_string.append(route | "").append(",").append(stop_id).append(",0;");
       }
+
+      // Optional fixed timetable, used while the websocket is down:
+      //   "timetable": [{"routeId": "...", "routeName": "...", "headsign": "...",
+      //                  "days": [1, 2, 3, 4, 5], "departures": ["06:05", 380, ...]}]
+      // Days are ISO weekdays (1 = Monday) and default to every day;
+      // departures are "HH:MM" or minutes after midnight.
+      for (JsonObject entry : stop["timetable"].as<JsonArray>()) {
+        std::vector<uint16_t> departures;
+        for (JsonVariant departure : entry["departures"].as<JsonArray>()) {
+          int minutes = departure.is<int>() ? departure.as<int>() : parse_time_of_day(departure.as<const char*>());
+          if (minutes >= 0 && minutes < 48 * 60) {
+            departures.push_back(minutes);
+          }
+        }
+
+        uint8_t days = StaticTimetable::ALL_DAYS;
+        if (entry.containsKey("days")) {
+          days = 0;
+          for (JsonVariant day : entry["days"].as<JsonArray>()) {
+            int iso_day = day.as<int>();
+            if (iso_day >= 1 && iso_day <= 7) {
+              days |= 1 << (iso_day - 1);
+            }
+          }
+        }
+
+        config.timetable.add_entry(stop_id, entry["routeId"] | "", entry["routeName"] | "",
+                                   entry["headsign"] | "", days, std::move(departures));
+      }
+
+      // The timetable is persisted separately in its compact encoding
+      stop.remove("timetable");
     }
 
+    serializeJson(root, config.persisted_body);
     return true;
   });
 
   if (!success) {
+    return false;
+  }
+
+  for (std::string &schedule_string : config.schedule_strings) {
+    if (!schedule_string.empty() && schedule_string.back() == ';') {
+      schedule_string.pop_back();
+    }
+  }
+
+  return true;
+}
+
+void TransitTracker::apply_remote_config_(RemoteConfig &&config) {
+  for (size_t i = 0; i < this->sources_.size() && i < config.schedule_strings.size(); i++) {
+    FeedSource &source = *this->sources_[i];
+    source.schedule_string = std::move(config.schedule_strings[i]);
+    ESP_LOGD(TAG, "Updated schedule for %s: %s", source.base_url.c_str(), source.schedule_string.c_str());
+    this->build_subscribe_message_(source);
+  }
+  this->stop_ids_ = std::move(config.stop_ids);
+  this->stop_names_ = std::move(config.stop_names);
+  this->timetable_ = std::move(config.timetable);
+  this->persisted_config_body_ = std::move(config.persisted_body);
+
+  // Restart paging from the first stop on the next tick
+  this->current_stop_index_ = 0;
+  this->current_subpage_index_ = 0;
+  this->total_subpages_for_current_stop_ = 1;
+  this->last_displayed_stop_name_.clear();
+  this->current_page_duration_ = 0;
+
+  // Trips of the previous subscription no longer match the stop list
+  this->schedule_state_.set_stops(this->stop_ids_, this->trips_per_stop_());
+}
+
+void TransitTracker::on_remote_config_fetched_(const ConfigFetchResult &result) {
+  if (this->config_loaded_) {
+    this->on_remote_config_polled_(result);
+    return;
+  }
+
+  if (result.status_code != HTTP_CODE_OK) {
+    ESP_LOGE(TAG, "Failed to fetch config JSON. HTTP code: %d", result.status_code);
+    this->connect_ws_();
+    return;
+  }
+
+  RemoteConfig config;
+  if (!this->parse_remote_config_(result.body, config)) {
     this->status_set_error("Failed to parse schedule config JSON");
+    this->connect_ws_();
     return;
   }
 
-  if (!new_schedule_string.empty() && new_schedule_string.back() == ';') {
-    new_schedule_string.pop_back();
+  this->apply_remote_config_(std::move(config));
+  this->config_payload_hash_ = std::hash<std::string>{}(result.body);
+  this->config_etag_ = result.etag;
+  this->config_last_modified_ = result.last_modified;
+  this->config_loaded_ = true;
+  this->persist_config_();
+  this->persist_timetable_();
+
+  this->connect_ws_();
+  this->poll_remote_config_changes();
+}
+
+void TransitTracker::poll_remote_config_changes() {
+  // re-fetch and hot-apply if the server indicates a change - every 4 hours
+  this->set_timeout("poll_remote_config", 4 * 60 * 60 * 1000, [this]() {
+    this->update_schedule_string_from_remote_config();
+  });
+}
+
+void TransitTracker::on_remote_config_polled_(const ConfigFetchResult &result) {
+  if (result.status_code == HTTP_CODE_NOT_MODIFIED) {
+    ESP_LOGI(TAG, "Config unchanged (not modified)");
+  } else if (result.status_code == HTTP_CODE_OK) {
+    // Server without cache validators (or validators changed): fall back to
+    // comparing the content itself
+    size_t new_hash = std::hash<std::string>{}(result.body);
+    RemoteConfig config;
+    bool accepted = true;
+    if (new_hash == this->config_payload_hash_) {
+      ESP_LOGI(TAG, "Config unchanged");
+    } else if (!this->parse_remote_config_(result.body, config)) {
+      ESP_LOGW(TAG, "Changed config could not be parsed; keeping current config");
+      accepted = false;
+    } else {
+      ESP_LOGI(TAG, "Config content changed — applying");
+      this->apply_remote_config_(std::move(config));
+      for (auto &source : this->sources_) {
+        this->send_subscribe_(*source);
+      }
+    }
+
+    if (accepted) {
+      this->config_payload_hash_ = new_hash;
+      this->config_etag_ = result.etag;
+      this->config_last_modified_ = result.last_modified;
+      this->persist_config_();
+      this->persist_timetable_();
+    }
+  } else {
+    ESP_LOGW(TAG, "Failed to poll config JSON. HTTP code: %d", result.status_code);
   }
 
-  this->schedule_string_ = new_schedule_string;
-  this->stop_ids_ = new_stop_ids;
-  this->stop_names_ = new_stop_names;
-  ESP_LOGD(TAG, "Updated schedule_string_: %s", this->schedule_string_.c_str());
-    
-  this->poll_remote_config_changes(payloadHash);
+  this->poll_remote_config_changes();
 }
 
-void TransitTracker::poll_remote_config_changes(const size_t payloadHash) {
-  // reboot if server indicates change - every 4 hours
-  this->set_timeout(4 * 60 * 60 * 1000, [this, payloadHash]() {
-    HTTPClient http2;
-    http2.begin(this->config_url_.c_str());
-    int code = http2.GET();
-    
-    if (code == HTTP_CODE_OK) {
-      std::string body = http2.getString().c_str();
-      size_t new_hash = std::hash<std::string>{}(body);
-      if (new_hash != payloadHash) {
-        ESP_LOGW(TAG, "Config content changed — rebooting");
-        ESP.restart();
-      } else {
-        ESP_LOGI(TAG, "Config unchanged after 30s");
+bool TransitTracker::restore_config_() {
+  std::unique_ptr<PersistedBlob<PERSISTED_CONFIG_SIZE>> blob(new PersistedBlob<PERSISTED_CONFIG_SIZE>());
+  if (!this->config_pref_.load(blob.get()) || !blob->is_valid()) {
+    return false;
+  }
+
+  BlobReader reader(blob->data, blob->length);
+  const char *body, *etag, *last_modified;
+  size_t body_length, etag_length, last_modified_length;
+  uint32_t payload_hash;
+  if (!reader.read_string(body, body_length) ||
+      !reader.read_string(etag, etag_length) ||
+      !reader.read_string(last_modified, last_modified_length) ||
+      !reader.read_u32(payload_hash)) {
+    return false;
+  }
+
+  RemoteConfig config;
+  if (!this->parse_remote_config_(std::string(body, body_length), config)) {
+    return false;
+  }
+
+  ESP_LOGD(TAG, "Restored persisted config");
+  this->apply_remote_config_(std::move(config));
+  // Hash of this device's serialized config subtree the persisted config
+  // was derived from, so an unchanged remote config is recognised as such
+  this->config_payload_hash_ = payload_hash;
+  this->config_etag_.assign(etag, etag_length);
+  this->config_last_modified_.assign(last_modified, last_modified_length);
+  this->persisted_config_checksum_ = blob->checksum;
+  this->config_loaded_ = true;
+
+  std::unique_ptr<PersistedBlob<PERSISTED_TIMETABLE_SIZE>> timetable(new PersistedBlob<PERSISTED_TIMETABLE_SIZE>());
+  if (this->timetable_pref_.load(timetable.get()) && timetable->is_valid()) {
+    this->timetable_.set_data(timetable->data, timetable->length);
+    this->persisted_timetable_checksum_ = timetable->checksum;
+  }
+
+  return true;
+}
+
+void TransitTracker::persist_config_() {
+  std::unique_ptr<PersistedBlob<PERSISTED_CONFIG_SIZE>> blob(new PersistedBlob<PERSISTED_CONFIG_SIZE>());
+
+  const std::string &body = this->persisted_config_body_;
+  BlobWriter writer(blob->data, sizeof(blob->data));
+  if (!writer.write_string(body.data(), body.size()) ||
+      !writer.write_string(this->config_etag_.data(), this->config_etag_.size()) ||
+      !writer.write_string(this->config_last_modified_.data(), this->config_last_modified_.size()) ||
+      !writer.write_u32(this->config_payload_hash_)) {
+    ESP_LOGW(TAG, "Config too large to persist (%u bytes)", body.size());
+    return;
+  }
+
+  blob->seal(writer.size());
+  if (blob->checksum == this->persisted_config_checksum_) {
+    return;
+  }
+
+  if (this->config_pref_.save(blob.get())) {
+    this->persisted_config_checksum_ = blob->checksum;
+    ESP_LOGD(TAG, "Persisted config (%u bytes)", writer.size());
+  }
+}
+
+void TransitTracker::persist_timetable_() {
+  const std::vector<uint8_t> &data = this->timetable_.data();
+  if (data.size() > PERSISTED_TIMETABLE_SIZE) {
+    ESP_LOGW(TAG, "Timetable too large to persist (%u bytes)", data.size());
+    return;
+  }
+
+  std::unique_ptr<PersistedBlob<PERSISTED_TIMETABLE_SIZE>> blob(new PersistedBlob<PERSISTED_TIMETABLE_SIZE>());
+  memcpy(blob->data, data.data(), data.size());
+  blob->seal(data.size());
+  if (blob->checksum == this->persisted_timetable_checksum_) {
+    return;
+  }
+
+  if (this->timetable_pref_.save(blob.get())) {
+    this->persisted_timetable_checksum_ = blob->checksum;
+    ESP_LOGD(TAG, "Persisted timetable (%u bytes)", data.size());
+  }
+}
+
+size_t TransitTracker::trips_per_stop_() const {
+  return std::max(this->display_limit_, 1) + TRIP_HEADROOM;
+}
+
+void TransitTracker::project_offline_schedule_() {
+  ESPTime now = this->rtc_->now();
+  if (!now.is_valid()) {
+    return;
+  }
+
+  const time_t midnight = now.timestamp - (now.hour * 3600 + now.minute * 60 + now.second);
+  // ESPTime counts weekdays from Sunday = 1; the timetable from Monday = bit 0
+  const int today = (now.day_of_week + 5) % 7;
+
+  this->schedule_state_.begin_generation();
+
+  this->timetable_.for_each_entry([&](const TimetableEntry &entry) {
+    const int stop = this->schedule_state_.find_stop(entry.stop_id, entry.stop_id_length);
+    if (stop < 0) {
+      return;
+    }
+
+    Color route_color = this->default_route_color_;
+    StringRef route_name;
+    const char *style_name;
+    if (this->find_route_style_(entry.route_id, entry.route_id_length, &style_name, &route_color)) {
+      route_name = this->schedule_state_.store(style_name);
+    } else if (entry.route_name_length > 0) {
+      route_name = this->schedule_state_.store(entry.route_name, entry.route_name_length);
+    } else {
+      route_name = this->schedule_state_.store(entry.route_id, entry.route_id_length);
+    }
+
+    StringRef stop_id = this->schedule_state_.store(entry.stop_id, entry.stop_id_length);
+    StringRef route_id = this->schedule_state_.store(entry.route_id, entry.route_id_length);
+    StringRef headsign = this->schedule_state_.store(entry.headsign, entry.headsign_length);
+
+    int projected = 0;
+    // Yesterday's service day covers departures listed past 24:00
+    for (int day_offset = -1; day_offset <= 1 && projected < this->limit_; day_offset++) {
+      int service_day = (today + day_offset + 7) % 7;
+      if ((entry.days & (1 << service_day)) == 0) {
+        continue;
+      }
+
+      for (uint16_t minutes : entry.departures) {
+        time_t departure = midnight + day_offset * 86400 + minutes * 60;
+        if (departure < now.timestamp) {
+          continue;
+        }
+        if (!this->schedule_state_.accepts(stop, departure, departure)) {
+          break;  // Later departures would be dropped too
+        }
+
+        Trip new_trip{
+          .stop_id        = stop_id,
+          .route_id       = route_id,
+          .route_name     = route_name,
+          .route_color    = route_color,
+          .headsign       = headsign,
+          .arrival_time   = departure,
+          .departure_time = departure,
+          .is_realtime    = false,
+        };
+        this->prepare_trip_(new_trip, true);
+        this->schedule_state_.add(stop, new_trip);
+
+        if (++projected >= this->limit_) {
+          break;
+        }
       }
     }
-    http2.end();
-      
-    this->poll_remote_config_changes(payloadHash);
   });
+
+  ESP_LOGD(TAG, "Projected %u trips from the static timetable", this->schedule_state_.pending_size());
+  this->schedule_state_.commit_generation(true);
+}
+
+void TransitTracker::restore_schedule_() {
+  std::unique_ptr<PersistedBlob<PERSISTED_SCHEDULE_SIZE>> blob(new PersistedBlob<PERSISTED_SCHEDULE_SIZE>());
+  if (!this->schedule_pref_.load(blob.get()) || !blob->is_valid()) {
+    return;
+  }
+
+  this->schedule_state_.begin_generation();
+  BlobReader reader(blob->data, blob->length);
+  while (!reader.at_end()) {
+    const char *stop_id, *route_id, *route_name, *headsign;
+    size_t stop_id_length, route_id_length, route_name_length, headsign_length;
+    uint32_t route_color, arrival_time, departure_time;
+    if (!reader.read_string(stop_id, stop_id_length) ||
+        !reader.read_string(route_id, route_id_length) ||
+        !reader.read_string(route_name, route_name_length) ||
+        !reader.read_string(headsign, headsign_length) ||
+        !reader.read_u32(route_color) ||
+        !reader.read_u32(arrival_time) ||
+        !reader.read_u32(departure_time)) {
+      break;
+    }
+
+    const int stop = this->schedule_state_.find_stop(stop_id, stop_id_length);
+    if (!this->schedule_state_.accepts(stop, arrival_time, departure_time)) {
+      continue;
+    }
+
+    Trip new_trip{
+      .stop_id        = this->schedule_state_.store(stop_id, stop_id_length),
+      .route_id       = this->schedule_state_.store(route_id, route_id_length),
+      .route_name     = this->schedule_state_.store(route_name, route_name_length),
+      .route_color    = Color(route_color),
+      .headsign       = this->schedule_state_.store(headsign, headsign_length),
+      .arrival_time   = static_cast<time_t>(arrival_time),
+      .departure_time = static_cast<time_t>(departure_time),
+      // Snapshot times are at best as good as the schedule
+      .is_realtime    = false,
+    };
+    this->prepare_trip_(new_trip, true);
+    this->schedule_state_.add(stop, new_trip);
+  }
+
+  ESP_LOGD(TAG, "Restored %u trips from schedule snapshot", this->schedule_state_.pending_size());
+  this->persisted_schedule_checksum_ = blob->checksum;
+  this->schedule_state_.commit_generation(true);
+}
+
+void TransitTracker::persist_schedule_() {
+  // Synthetic and replayed schedules must not become the boot snapshot
+  if (this->config_url_.empty() || this->benchmarking_ || replaying_) {
+    return;
+  }
+
+  uint32_t now = millis();
+  if (this->last_schedule_snapshot_ != 0 && now - this->last_schedule_snapshot_ < SCHEDULE_SNAPSHOT_INTERVAL_MS) {
+    return;
+  }
+
+  std::unique_ptr<PersistedBlob<PERSISTED_SCHEDULE_SIZE>> blob(new PersistedBlob<PERSISTED_SCHEDULE_SIZE>());
+  BlobWriter writer(blob->data, sizeof(blob->data));
+
+  {
+    std::lock_guard<std::mutex> lock(this->schedule_state_.mutex);
+    for (const Trip &trip : this->schedule_state_.trips) {
+      size_t mark = writer.mark();
+      if (!writer.write_string(trip.stop_id.c_str(), trip.stop_id.size()) ||
+          !writer.write_string(trip.route_id.c_str(), trip.route_id.size()) ||
+          !writer.write_string(trip.route_name.c_str(), trip.route_name.size()) ||
+          !writer.write_string(trip.headsign.c_str(), trip.headsign.size()) ||
+          !writer.write_u32((trip.route_color.r << 16) | (trip.route_color.g << 8) | trip.route_color.b) ||
+          !writer.write_u32(trip.arrival_time) ||
+          !writer.write_u32(trip.departure_time)) {
+        // Keep the trips that fit
+        writer.rewind(mark);
+        break;
+      }
+    }
+  }
+
+  this->last_schedule_snapshot_ = now;
+
+  blob->seal(writer.size());
+  if (blob->checksum == this->persisted_schedule_checksum_) {
+    return;
+  }
+
+  if (this->schedule_pref_.save(blob.get())) {
+    this->persisted_schedule_checksum_ = blob->checksum;
+    ESP_LOGD(TAG, "Persisted schedule snapshot (%u bytes)", writer.size());
+  }
+}
+
+void TransitTracker::add_abbreviation(const std::string &from, const std::string &to) {
+  this->override_abbreviations_();
+  this->abbreviations_[from] = to;
+}
+
+void TransitTracker::add_route_style(const std::string &route_id, const std::string &name, const Color &color) {
+  this->override_route_styles_();
+  this->route_styles_.insert(route_id.data(), route_id.size(), name.data(), name.size(), color);
+}
+
+void TransitTracker::override_abbreviations_() {
+  if (this->abbreviations_overridden_) {
+    return;
+  }
+  this->abbreviations_overridden_ = true;
+  for (size_t i = 0; i < this->static_abbreviation_count_; i++) {
+    const StaticAbbreviation &abbr = this->static_abbreviations_[i];
+    this->abbreviations_[std::string(abbr.from, abbr.from_length)] = std::string(abbr.to, abbr.to_length);
+  }
+}
+
+void TransitTracker::override_route_styles_() {
+  if (this->route_styles_overridden_) {
+    return;
+  }
+  this->route_styles_overridden_ = true;
+  this->route_styles_.reserve(this->static_route_style_count_);
+  for (size_t i = 0; i < this->static_route_style_count_; i++) {
+    const StaticRouteStyle &style = this->static_route_styles_[i];
+    this->route_styles_.insert(style.route_id, strlen(style.route_id), style.name, strlen(style.name), *style.color);
+  }
+}
+
+bool TransitTracker::find_route_style_(const char *route_id, size_t length, const char **name, Color *color) const {
+  if (this->route_styles_overridden_) {
+    return this->route_styles_.find(route_id, length, name, color);
+  }
+
+  const StaticRouteStyle *style =
+      find_static_route_style(this->static_route_styles_, this->static_route_style_count_, route_id, length);
+  if (style == nullptr) {
+    return false;
+  }
+  *name = style->name;
+  *color = *style->color;
+  return true;
+}
+
+void TransitTracker::apply_abbreviations_(std::string &headsign) const {
+  if (this->abbreviations_overridden_) {
+    for (const auto &abbr : this->abbreviations_) {
+      size_t pos = headsign.find(abbr.first);
+      if (pos != std::string::npos) {
+        ESP_LOGV(TAG, "Applying abbreviation '%s' -> '%s' in headsign",
+                 abbr.first.c_str(), abbr.second.c_str());
+        headsign.replace(pos, abbr.first.length(), abbr.second);
+      }
+    }
+    return;
+  }
+
+  // Sorted by key, so abbreviations apply in the same order as from the map
+  for (size_t i = 0; i < this->static_abbreviation_count_; i++) {
+    const StaticAbbreviation &abbr = this->static_abbreviations_[i];
+    size_t pos = headsign.find(abbr.from, 0, abbr.from_length);
+    if (pos != std::string::npos) {
+      ESP_LOGV(TAG, "Applying abbreviation '%s' -> '%s' in headsign", abbr.from, abbr.to);
+      headsign.replace(pos, abbr.from_length, abbr.to, abbr.to_length);
+    }
+  }
 }
 
 void TransitTracker::set_abbreviations_from_text(const std::string &text) {
+  this->abbreviations_overridden_ = true;
   this->abbreviations_.clear();
   for (const auto &line : split(text, '\n')) {
     auto parts = split(line, ';');
@@ -451,8 +1228,12 @@ void TransitTracker::set_abbreviations_from_text(const std::string &text) {
 }
 
 void TransitTracker::set_route_styles_from_text(const std::string &text) {
+  this->route_styles_overridden_ = true;
   this->route_styles_.clear();
-  for (const auto &line : split(text, '\n')) {
+  // Sized once up front, so the table is built without rehashing
+  const auto lines = split(text, '\n');
+  this->route_styles_.reserve(lines.size());
+  for (const auto &line : lines) {
     auto parts = split(line, ';');
     if (parts.size() != 3) {
       ESP_LOGW(TAG, "Invalid route style line: %s", line.c_str());
@@ -469,55 +1250,26 @@ void TransitTracker::draw_text_centered_(const char *text, Color color) {
   this->display_->print(display_center_x, display_center_y, this->font_, color, display::TextAlign::CENTER, text);
 }
 
-std::string TransitTracker::from_now_(time_t unix_timestamp) const {
+const char *TransitTracker::from_now_(time_t unix_timestamp, char *buffer) const {
   if (this->rtc_ == nullptr) {
     return "";
   }
 
   uint now = this->rtc_->now().timestamp;
 
-  int diff = unix_timestamp - now;
-
-  if (diff < 30) {
-    return "Now";
-  }
-
-  if (diff < 60) {
-    switch (this->unit_display_) {
-      case UNIT_DISPLAY_LONG:
-        return "0min";
-      case UNIT_DISPLAY_SHORT:
-        return "0m";
-      case UNIT_DISPLAY_NONE:
-        return "0";
-    }
-  }
-
-  int minutes = diff / 60;
-
-  if (minutes < 60) {
-    switch (this->unit_display_) {
-      case UNIT_DISPLAY_LONG:
-        return str_sprintf("%dmin", minutes);
-      case UNIT_DISPLAY_SHORT:
-        return str_sprintf("%dm", minutes);
-      case UNIT_DISPLAY_NONE:
-      default:
-        return str_sprintf("%d", minutes);
-    }
-  }
+  return this->format_duration_(unix_timestamp - now, buffer);
+}
 
-  int hours = minutes / 60;
-  minutes = minutes % 60;
+void TransitTracker::prepare_trip_(Trip &trip, bool stale) const {
+  trip.display_time = this->display_departure_times_ ? trip.departure_time : trip.arrival_time;
+  trip.time_color = trip.is_realtime ? Color(0x20FF00) : stale ? Color(0x5c5c5c) : Color(0xa7a7a7);
 
-  switch (this->unit_display_) {
-    case UNIT_DISPLAY_LONG:
-    case UNIT_DISPLAY_SHORT:
-      return str_sprintf("%dh%dm", hours, minutes);
-    case UNIT_DISPLAY_NONE:
-    default:
-      return str_sprintf("%d:%02d", hours, minutes);
-  }
+  int width, x_offset, baseline, height;
+  this->font_->measure(trip.route_name.c_str(), &width, &x_offset, &baseline, &height);
+  trip.route_name_width = width;
+  trip.line_height = height;
+  this->font_->measure(trip.headsign.c_str(), &width, &x_offset, &baseline, &height);
+  trip.headsign_width = width;
 }
 
 const uint8_t realtime_icon[6][6] = {
@@ -654,6 +1406,13 @@ void HOT TransitTracker::draw_schedule() {
     return;
   }
 
+  if (this->render_pending_since_us_ != 0 && this->display_ != &this->render_probe_) {
+    uint32_t latency_us = micros() - this->render_pending_since_us_;
+    this->render_pending_since_us_ = 0;
+    this->max_render_latency_us_ = std::max(this->max_render_latency_us_, latency_us);
+    ESP_LOGV(TAG, "Schedule update reached the display after %ums", latency_us / 1000);
+  }
+
   if (!esphome::network::is_connected()) {
     this->draw_text_centered_("Connecting to Wi-Fi", Color(0x252627));
     return;
@@ -664,17 +1423,24 @@ void HOT TransitTracker::draw_schedule() {
     return;
   }
 
-  if (this->base_url_.empty()) {
+  if (this->sources_.empty()) {
     this->draw_text_centered_("No base URL set", Color(0x252627));
     return;
   }
 
-  if (this->status_has_error()) {
+  if (!this->config_loaded_ && this->config_fetcher_.is_busy()) {
+    this->draw_text_centered_("Loading...", Color(0x252627));
+    return;
+  }
+
+  // Offline trips projected from the static timetable override the error
+  if (this->status_has_error() && !this->schedule_state_.is_stale) {
     this->draw_text_centered_("Error loading schedule", Color(0xFE4C5C));
     return;
   }
 
-  if (!this->has_ever_connected_) {
+  // A schedule restored from flash is shown (marked stale) until live data arrives
+  if (!this->has_ever_connected_ && !this->schedule_state_.is_stale) {
     this->draw_text_centered_("Loading...", Color(0x252627));
     return;
   }
@@ -684,22 +1450,35 @@ void HOT TransitTracker::draw_schedule() {
     return;
   }
 
-  const auto &stop_id = stop_ids_[current_stop_index_];
-
   std::lock_guard<std::mutex> lock(this->schedule_state_.mutex);
+  AllocScope alloc_scope(ALLOC_CATEGORY_RENDER);
+
+  // Trips for this stop, soonest first. The span is walked in place: once
+  // to count what fits and size the route column, then again to draw.
+  const TripSpan trips = this->schedule_state_.trips_for_stop(current_stop_index_);
+  const bool is_stale = this->schedule_state_.is_stale;
+  const time_t now = this->rtc_->now().timestamp;
+  auto departed = [is_stale, now](const Trip &trip) {
+    // Stale trips may have departed since the snapshot was taken
+    return is_stale && trip.departure_time < now;
+  };
 
-  // Filter trips for this stop
-  std::vector<const Trip*> matching_trips;
-  for (const Trip &trip : this->schedule_state_.trips) {
-    if (trip.stop_id == stop_id) {
-      matching_trips.push_back(&trip);
-    }
-    if (matching_trips.size() >= this->display_limit_) {
+  // Widths, colors and the time to show were worked out when the trips were
+  // stored; only the time until departure changes from frame to frame
+  int visible_trips = 0;
+  int routeMaxWidth = 0;
+  for (const Trip &trip : trips) {
+    if (visible_trips >= this->display_limit_) {
       break;  // Stop once display limit is reached
     }
+    if (departed(trip)) {
+      continue;
+    }
+    routeMaxWidth = std::max<int>(routeMaxWidth, trip.route_name_width);
+    visible_trips++;
   }
 
-  if (matching_trips.empty()) {
+  if (visible_trips == 0) {
     auto message = "No upcoming arrivals";
     if (this->display_departure_times_) {
       message = "No upcoming departures";
@@ -709,42 +1488,46 @@ void HOT TransitTracker::draw_schedule() {
     return;
   }
 
-  int routeMaxWidth = 0;
-  for (const Trip* trip : matching_trips) {
-    int route_width, route_x_offset, route_baseline, route_height;
-    this->font_->measure(trip->route_name.c_str(), &route_width, &route_x_offset, &route_baseline, &route_height);
-    routeMaxWidth = std::max(routeMaxWidth, route_width);
-  }
-
   int y_offset = 2;
-  for (const Trip* trip : matching_trips) {
-    this->display_->print(0, y_offset, this->font_, trip->route_color, display::TextAlign::TOP_LEFT, trip->route_name.c_str());
+  int drawn_trips = 0;
+  for (const Trip &trip : trips) {
+    if (drawn_trips >= visible_trips) {
+      break;
+    }
+    if (departed(trip)) {
+      continue;
+    }
+    drawn_trips++;
 
-    int route_width, route_x_offset, route_baseline, route_height;
-    this->font_->measure(trip->route_name.c_str(), &route_width, &route_x_offset, &route_baseline, &route_height);
+    this->display_->print(0, y_offset, this->font_, trip.route_color, display::TextAlign::TOP_LEFT, trip.route_name.c_str());
 
-    auto time_display = this->from_now_(this->display_departure_times_ ? trip->departure_time : trip->arrival_time);
+    char time_buffer[DURATION_BUFFER_SIZE];
+    const char *time_display = this->from_now_(trip.display_time, time_buffer);
 
     int time_width, time_x_offset, time_baseline, time_height;
-    this->font_->measure(time_display.c_str(), &time_width, &time_x_offset, &time_baseline, &time_height);
+    this->font_->measure(time_display, &time_width, &time_x_offset, &time_baseline, &time_height);
 
     int headsign_clipping_end = this->display_->get_width() - time_width - 4;
 
-    Color time_color = trip->is_realtime ? Color(0x20FF00) : Color(0xa7a7a7);
-    this->display_->print(this->display_->get_width() + 1, y_offset, this->font_, time_color, display::TextAlign::TOP_RIGHT, time_display.c_str());
+    this->display_->print(this->display_->get_width() + 1, y_offset, this->font_, trip.time_color, display::TextAlign::TOP_RIGHT, time_display);
 
-    if (trip->is_realtime) {
+    if (trip.is_realtime) {
       int icon_bottom_right_x = this->display_->get_width() - time_width - 2;
       int icon_bottom_right_y = y_offset + time_height - 6;
       headsign_clipping_end -= 8;
       this->draw_realtime_icon_(icon_bottom_right_x, icon_bottom_right_y);
     }
 
-    this->display_->start_clipping(0, 0, headsign_clipping_end, this->display_->get_height());
-    this->display_->print(routeMaxWidth + 3, y_offset, this->font_, trip->headsign.c_str());
-    this->display_->end_clipping();
+    const int headsign_x = routeMaxWidth + 3;
+    if (headsign_x + trip.headsign_width <= headsign_clipping_end) {
+      this->display_->print(headsign_x, y_offset, this->font_, trip.headsign.c_str());
+    } else {
+      this->display_->start_clipping(0, 0, headsign_clipping_end, this->display_->get_height());
+      this->display_->print(headsign_x, y_offset, this->font_, trip.headsign.c_str());
+      this->display_->end_clipping();
+    }
 
-    y_offset += route_height;
+    y_offset += trip.line_height;
   }
 }
 
@@ -1,27 +1,52 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include <ArduinoWebsockets.h>
 
 #include "esphome/core/component.h"
+#include "esphome/core/preferences.h"
 #include "esphome/components/display/display.h"
 #include "esphome/components/font/font.h"
 #include "esphome/components/time/real_time_clock.h"
+#ifdef USE_SENSOR
+#include "esphome/components/sensor/sensor.h"
+#endif
 
+#include "arena.h"
+#include "config_fetcher.h"
+#include "duration_format.h"
+#include "feed_connection.h"
+#include "memory_telemetry.h"
+#include "render_probe.h"
+#include "route_tables.h"
 #include "schedule_state.h"
+#include "static_timetable.h"
 
 namespace esphome {
 namespace transit_tracker {
 
-struct RouteStyle {
-  std::string name;
-  Color color;
+struct RemoteConfig {
+  // Route/stop pairs to subscribe to, one entry per feed source
+  std::vector<std::string> schedule_strings;
+  std::vector<std::string> stop_ids;
+  std::map<std::string, std::string> stop_names;
+  StaticTimetable timetable;
+  // The config without its timetable, as persisted to flash
+  std::string persisted_body;
 };
 
-enum UnitDisplay : uint8_t {
-  UNIT_DISPLAY_LONG,
-  UNIT_DISPLAY_SHORT,
-  UNIT_DISPLAY_NONE
+// One websocket server the tracker subscribes to. Each source keeps its own
+// subscription; their trips are merged for display.
+struct FeedSource {
+  std::string base_url;
+  std::string feed_code;
+  // Shared with any other tracker instance subscribed to the same server
+  FeedConnection *connection = nullptr;
+  uint32_t subscription_id = 0;
+  std::string schedule_string;
+  // Serialized schedule:subscribe frame, ready to send on (re)connect
+  std::string subscribe_message;
 };
 
 class TransitTracker : public Component {
@@ -46,53 +71,173 @@ class TransitTracker : public Component {
     void set_base_url(const std::string &base_url) { base_url_ = base_url; }
     void set_config_url(const std::string &config_url) { config_url_ = config_url; }
     void set_feed_code(const std::string &feed_code) { feed_code_ = feed_code; }
+    // Only for servers that echo subscriptionId in schedule frames
+    void set_share_connection(bool share_connection) { share_connection_ = share_connection; }
+    void add_feed_source(const std::string &base_url, const std::string &feed_code) {
+      std::unique_ptr<FeedSource> source(new FeedSource());
+      source->base_url = base_url;
+      source->feed_code = feed_code;
+      sources_.push_back(std::move(source));
+    }
     void set_display_departure_times(bool display_departure_times) { display_departure_times_ = display_departure_times; }
     void set_tracker_name(const std::string &name) { tracker_name_ = name; }
     void set_list_mode(const std::string &list_mode) { list_mode_ = list_mode; }
     void set_limit(int limit) { limit_ = limit; }
     void set_display_limit(int limit) { display_limit_ = limit; }
 
-    void set_unit_display(UnitDisplay unit_display) { unit_display_ = unit_display; }
-    void add_abbreviation(const std::string &from, const std::string &to) { abbreviations_[from] = to; }
+    // Selected by codegen, so only the chosen unit display's formatter and
+    // minute table are compiled in
+    template<UnitDisplay U> void set_unit_display() {
+      unit_display_ = U;
+      format_duration_ = format_duration<U>;
+    }
+    void add_abbreviation(const std::string &from, const std::string &to);
     void set_default_route_color(const Color &color) { default_route_color_ = color; }
-    void add_route_style(const std::string &route_id, const std::string &name, const Color &color) { route_styles_[route_id] = RouteStyle{name, color}; }
+    void add_route_style(const std::string &route_id, const std::string &name, const Color &color);
+    // Tables generated from YAML, sorted by key; used until replaced by
+    // set_*_from_text()
+    void set_static_route_styles(const StaticRouteStyle *table, size_t size) {
+      static_route_styles_ = table;
+      static_route_style_count_ = size;
+    }
+    void set_static_abbreviations(const StaticAbbreviation *table, size_t size) {
+      static_abbreviations_ = table;
+      static_abbreviation_count_ = size;
+    }
 
     void set_abbreviations_from_text(const std::string &text);
     void set_route_styles_from_text(const std::string &text);
 
+    // Ceiling for the inbound JSON document, which is otherwise sized from
+    // each frame
+    void set_json_document_limit(size_t limit) { json_document_limit_ = limit; }
+
+    // Keeps up to `frames` raw websocket frames in a `buffer_size` byte
+    // PSRAM ring for dump_frame_capture() and replay_frame_capture()
+    void set_frame_capture(size_t frames, size_t buffer_size) {
+      frame_capture_frames_ = frames;
+      frame_capture_buffer_size_ = buffer_size;
+    }
+    void dump_frame_capture();
+    // Feeds the captured frames through parsing and rendering again and logs
+    // how long each took. Replayed trips stay on the board until the next
+    // live update.
+    void replay_frame_capture();
+    // Renders the current page off-panel and logs the pixel count, clipped
+    // pixels, output hash and render time
+    void measure_render();
+    // Sweeps synthetic schedules of growing size through parsing and
+    // rendering and logs one JSON line of results per case. Live data is
+    // suspended while it runs.
+    void run_benchmark();
+
+    void set_memory_update_interval(uint32_t interval) { memory_update_interval_ = interval; }
+#ifdef USE_SENSOR
+    void set_heap_free_sensor(sensor::Sensor *sensor) { heap_free_sensor_ = sensor; }
+    void set_heap_min_free_sensor(sensor::Sensor *sensor) { heap_min_free_sensor_ = sensor; }
+    void set_heap_largest_block_sensor(sensor::Sensor *sensor) { heap_largest_block_sensor_ = sensor; }
+    void set_psram_free_sensor(sensor::Sensor *sensor) { psram_free_sensor_ = sensor; }
+    void set_psram_min_free_sensor(sensor::Sensor *sensor) { psram_min_free_sensor_ = sensor; }
+    void set_psram_largest_block_sensor(sensor::Sensor *sensor) { psram_largest_block_sensor_ = sensor; }
+    void set_parse_allocations_sensor(sensor::Sensor *sensor) { parse_allocations_sensor_ = sensor; }
+    void set_render_allocations_sensor(sensor::Sensor *sensor) { render_allocations_sensor_ = sensor; }
+    void set_tls_allocations_sensor(sensor::Sensor *sensor) { tls_allocations_sensor_ = sensor; }
+    void set_render_latency_sensor(sensor::Sensor *sensor) { render_latency_sensor_ = sensor; }
+    void set_json_document_peak_sensor(sensor::Sensor *sensor) { json_document_peak_sensor_ = sensor; }
+#endif
+
   protected:
-    std::string from_now_(time_t unix_timestamp) const;
+    // Time until `unix_timestamp`, formatted into `buffer` if it is not a
+    // constant string; `buffer` must hold DURATION_BUFFER_SIZE bytes
+    const char *from_now_(time_t unix_timestamp, char *buffer) const;
+    // Fills in the trip's render-ready fields
+    void prepare_trip_(Trip &trip, bool stale) const;
     void draw_text_centered_(const char *text, Color color);
     void draw_realtime_icon_(int bottom_right_x, int bottom_right_y);
 
+    RenderProbe render_probe_;
+    const RenderStats &probe_render_();
+    bool benchmarking_ = false;
+    // Set while captured frames are replayed; device-wide, as the capture
+    // holds frames of every instance's connections
+    static bool replaying_;
+
     ScheduleState schedule_state_;
 
+    MemoryTelemetry memory_telemetry_;
+    uint32_t memory_update_interval_ = 60000;
+    void update_memory_telemetry_();
+#ifdef USE_SENSOR
+    sensor::Sensor *heap_free_sensor_{nullptr};
+    sensor::Sensor *heap_min_free_sensor_{nullptr};
+    sensor::Sensor *heap_largest_block_sensor_{nullptr};
+    sensor::Sensor *psram_free_sensor_{nullptr};
+    sensor::Sensor *psram_min_free_sensor_{nullptr};
+    sensor::Sensor *psram_largest_block_sensor_{nullptr};
+    sensor::Sensor *parse_allocations_sensor_{nullptr};
+    sensor::Sensor *render_allocations_sensor_{nullptr};
+    sensor::Sensor *tls_allocations_sensor_{nullptr};
+    sensor::Sensor *render_latency_sensor_{nullptr};
+    sensor::Sensor *json_document_peak_sensor_{nullptr};
+#endif
+
+    // Time from receiving a schedule update to the first frame drawing it
+    uint32_t render_pending_since_us_ = 0;
+    uint32_t max_render_latency_us_ = 0;
+
     display::Display *display_;
     font::Font *font_;
     time::RealTimeClock *rtc_;
 
-    websockets::WebsocketsClient ws_client_{};
+    std::vector<std::unique_ptr<FeedSource>> sources_;
+    size_t json_document_limit_ = SCHEDULE_JSON_CAPACITY;
+    size_t frame_capture_frames_ = 0;
+    size_t frame_capture_buffer_size_ = 0;
+    // Reused across trips so abbreviating a headsign doesn't allocate
+    std::string headsign_scratch_;
 
-    void on_ws_message_(websockets::WebsocketsMessage message);
-    void on_ws_event_(websockets::WebsocketsEvent event, String data);
+    void on_ws_message_(size_t source_index, JsonObject root);
+    void on_ws_event_(size_t source_index, websockets::WebsocketsEvent event);
     void connect_ws_();
-    int connection_attempts_ = 0;
-    long last_heartbeat_ = 0;
+    void connect_source_(size_t source_index);
+    void schedule_reconnect_();
+    void update_connection_status_();
+    bool any_source_connected_();
+    // Whether every source has failed to connect at least `attempts` times
+    bool all_sources_failing_(int attempts) const;
+    // Display name and color of a styled route; false if the route has no style
+    bool find_route_style_(const char *route_id, size_t length, const char **name, Color *color) const;
+    void apply_abbreviations_(std::string &headsign) const;
+    void override_abbreviations_();
+    void override_route_styles_();
+    // Trips kept per stop: what the display shows plus some headroom
+    size_t trips_per_stop_() const;
+    void send_subscribe_(FeedSource &source);
+    void build_subscribe_message_(FeedSource &source);
     bool has_ever_connected_ = false;
     bool fully_closed_ = false;
 
     std::string base_url_;
     std::string feed_code_;
-    std::string schedule_string_;
+    bool share_connection_ = false;
     std::string list_mode_;
     bool display_departure_times_ = true;
     int limit_;
     int display_limit_;
 
     UnitDisplay unit_display_ = UNIT_DISPLAY_LONG;
+    DurationFormatter format_duration_ = format_duration<UNIT_DISPLAY_LONG>;
+    // The runtime maps start out empty and take over from the static tables,
+    // copying their entries, on the first change at runtime
     std::map<std::string, std::string> abbreviations_;
+    bool abbreviations_overridden_ = false;
+    const StaticAbbreviation *static_abbreviations_ = nullptr;
+    size_t static_abbreviation_count_ = 0;
     Color default_route_color_ = Color(0x028e51);
-    std::map<std::string, RouteStyle> route_styles_;
+    RouteStyleTable route_styles_;
+    bool route_styles_overridden_ = false;
+    const StaticRouteStyle *static_route_styles_ = nullptr;
+    size_t static_route_style_count_ = 0;
     std::map<std::string, std::string> stop_names_;
     std::vector<std::string> stop_ids_;
     std::string tracker_name_;
@@ -109,7 +254,36 @@ class TransitTracker : public Component {
     void draw_stop_name();
     void draw_schedule();
     void update_schedule_string_from_remote_config();
-    void poll_remote_config_changes(const size_t payloadHash);
+    void poll_remote_config_changes();
+
+    ConfigFetcher config_fetcher_;
+    bool config_loaded_ = false;
+    size_t config_payload_hash_ = 0;
+    std::string config_etag_;
+    std::string config_last_modified_;
+    void on_remote_config_fetched_(const ConfigFetchResult &result);
+    void on_remote_config_polled_(const ConfigFetchResult &result);
+    bool parse_remote_config_(const std::string &payload, RemoteConfig &config);
+    void apply_remote_config_(RemoteConfig &&config);
+
+    // Last good config and schedule, restored at boot for instant first paint
+    ESPPreferenceObject config_pref_;
+    ESPPreferenceObject schedule_pref_;
+    ESPPreferenceObject timetable_pref_;
+    std::string persisted_config_body_;
+    uint32_t persisted_config_checksum_ = 0;
+    uint32_t persisted_schedule_checksum_ = 0;
+    uint32_t persisted_timetable_checksum_ = 0;
+    uint32_t last_schedule_snapshot_ = 0;
+    bool restore_config_();
+    void persist_config_();
+    void persist_timetable_();
+    void restore_schedule_();
+    void persist_schedule_();
+
+    // Offline fallback while the websocket is down
+    StaticTimetable timetable_;
+    void project_offline_schedule_();
 };
 
 
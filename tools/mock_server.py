@@ -0,0 +1,339 @@
+#!/usr/bin/env python3
+"""Local stand-in for the Transit Tracker API, for testing without the internet.
+
+Serves, on one port:
+  GET /config.json  a fleet config with one device entry, keyed by --mac
+  ws://.../         the schedule websocket: answers schedule:subscribe with
+                    synthetic schedule frames every --interval seconds, plus
+                    heartbeats
+
+Point the device at it with
+  base_url: "ws://<host>:<port>/"
+  config_url: "http://<host>:<port>/config.json"
+
+Payload size, update rate and faults are all configurable; see --help. Each
+push is logged with its sequence number, size and send time, to line up with
+the device's render_latency sensor and logs.
+
+Standard library only; needs Python 3.8+.
+"""
+
+import argparse
+import asyncio
+import base64
+import hashlib
+import json
+import random
+import struct
+import time
+
+WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+OPCODE_TEXT = 0x1
+OPCODE_CLOSE = 0x8
+OPCODE_PING = 0x9
+OPCODE_PONG = 0xA
+
+
+def log(message):
+    print(f"{time.strftime('%H:%M:%S')}.{int(time.time() * 1000) % 1000:03d} {message}", flush=True)
+
+
+def build_config(args, revision=0):
+    if args.config_file:
+        with open(args.config_file) as f:
+            return f.read()
+
+    # Each revision moves the first stop to the end and renames the stops,
+    # so the config changes even with a single stop
+    rotation = revision % len(args.stops)
+    stop_ids = args.stops[rotation:] + args.stops[:rotation]
+
+    stops = []
+    for i, stop_id in enumerate(stop_ids):
+        stop = {
+            "stopId": stop_id,
+            "nickname": f"Stop {i} (rev {revision})" if revision else f"Stop {i}",
+            "routes": [f"route_{r}" for r in range(args.routes)],
+        }
+        if args.timetable:
+            stop["timetable"] = [
+                {
+                    "routeId": f"route_{r}",
+                    "routeName": str(r),
+                    "headsign": f"Timetable {r}",
+                    "departures": list(range(5 * 60 + r, 24 * 60, 15)),
+                }
+                for r in range(args.routes)
+            ]
+        stops.append(stop)
+    return json.dumps({args.mac: {"stops": stops}})
+
+
+def build_schedule(args, subscription_id, sequence):
+    now = int(time.time())
+    trips = []
+    for i in range(args.trips):
+        route = i % args.routes
+        headsign = f"Update {sequence} trip {i} "
+        headsign = (headsign * (args.headsign_length // len(headsign) + 1))[: args.headsign_length]
+        trips.append(
+            {
+                "stopId": args.stops[i % len(args.stops)],
+                "routeId": f"route_{route}",
+                "routeName": str(route),
+                "routeColor": f"{(route * 0x3F5A7) & 0xFFFFFF:06X}",
+                "headsign": headsign,
+                "arrivalTime": now + 60 * (i + 1),
+                "departureTime": now + 60 * (i + 1) + 30,
+                "isRealtime": i % 2 == 0,
+            }
+        )
+
+    data = {"trips": trips}
+    if args.echo_subscription_id and subscription_id is not None:
+        data["subscriptionId"] = subscription_id
+    return json.dumps({"event": "schedule", "data": data})
+
+
+class WebSocket:
+    def __init__(self, reader, writer):
+        self.reader = reader
+        self.writer = writer
+
+    async def send(self, payload, opcode=OPCODE_TEXT):
+        if isinstance(payload, str):
+            payload = payload.encode()
+        header = bytes([0x80 | opcode])
+        length = len(payload)
+        if length < 126:
+            header += bytes([length])
+        elif length < 1 << 16:
+            header += bytes([126]) + struct.pack("!H", length)
+        else:
+            header += bytes([127]) + struct.pack("!Q", length)
+        self.writer.write(header + payload)
+        await self.writer.drain()
+
+    async def receive(self):
+        """Returns the next text message, or None once the connection closes."""
+        while True:
+            first, second = await self.reader.readexactly(2)
+            opcode = first & 0x0F
+            length = second & 0x7F
+            if length == 126:
+                (length,) = struct.unpack("!H", await self.reader.readexactly(2))
+            elif length == 127:
+                (length,) = struct.unpack("!Q", await self.reader.readexactly(8))
+            mask = await self.reader.readexactly(4) if second & 0x80 else b"\0\0\0\0"
+            payload = bytearray(await self.reader.readexactly(length))
+            for i in range(length):
+                payload[i] ^= mask[i % 4]
+
+            if opcode == OPCODE_CLOSE:
+                return None
+            if opcode == OPCODE_PING:
+                await self.send(bytes(payload), OPCODE_PONG)
+            elif opcode == OPCODE_TEXT:
+                return payload.decode(errors="replace")
+
+
+class MockServer:
+    def __init__(self, args):
+        self.args = args
+        self.started = time.monotonic()
+        self.config = None
+        self.config_etag = None
+        self.sequence = 0
+
+    def refresh_config(self):
+        revision = 0
+        if self.args.rotate_config > 0:
+            revision = int((time.monotonic() - self.started) // self.args.rotate_config)
+        config = build_config(self.args, revision)
+        if config != self.config:
+            if self.config is not None:
+                log("config changed")
+            self.config = config
+            self.config_etag = '"' + hashlib.sha1(config.encode()).hexdigest()[:16] + '"'
+
+    async def handle(self, reader, writer):
+        peer = writer.get_extra_info("peername")
+        try:
+            request_line = (await reader.readline()).decode(errors="replace").strip()
+            headers = {}
+            while True:
+                line = (await reader.readline()).decode(errors="replace").strip()
+                if not line:
+                    break
+                name, _, value = line.partition(":")
+                headers[name.strip().lower()] = value.strip()
+
+            method, path, _ = (request_line.split(" ") + ["", "", ""])[:3]
+            if headers.get("upgrade", "").lower() == "websocket":
+                await self.serve_websocket(reader, writer, headers, peer)
+            elif method == "GET" and path.split("?")[0] == "/config.json":
+                await self.serve_config(writer, headers, peer)
+            else:
+                await self.respond(writer, 404, b"Not found")
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        finally:
+            writer.close()
+
+    async def respond(self, writer, status, body, extra_headers=()):
+        reason = {200: "OK", 304: "Not Modified", 404: "Not Found"}.get(status, "Error")
+        head = [f"HTTP/1.0 {status} {reason}", f"Content-Length: {len(body)}", "Connection: close"]
+        head.extend(extra_headers)
+        writer.write(("\r\n".join(head) + "\r\n\r\n").encode() + body)
+        await writer.drain()
+
+    async def serve_config(self, writer, headers, peer):
+        await asyncio.sleep(self.args.config_delay)
+        self.refresh_config()
+        if self.args.config_status != 200:
+            log(f"config {peer}: injected HTTP {self.args.config_status}")
+            await self.respond(writer, self.args.config_status, b"Injected failure")
+        elif headers.get("if-none-match") == self.config_etag:
+            log(f"config {peer}: not modified")
+            await self.respond(writer, 304, b"", [f"ETag: {self.config_etag}"])
+        else:
+            log(f"config {peer}: {len(self.config)} bytes")
+            await self.respond(
+                writer, 200, self.config.encode(),
+                ["Content-Type: application/json", f"ETag: {self.config_etag}"],
+            )
+
+    async def serve_websocket(self, reader, writer, headers, peer):
+        if random.random() < self.args.refuse_rate:
+            log(f"ws {peer}: injected connection refusal")
+            return
+
+        accept = base64.b64encode(
+            hashlib.sha1((headers.get("sec-websocket-key", "") + WEBSOCKET_GUID).encode()).digest()
+        ).decode()
+        writer.write(
+            (
+                "HTTP/1.1 101 Switching Protocols\r\n"
+                "Upgrade: websocket\r\nConnection: Upgrade\r\n"
+                f"Sec-WebSocket-Accept: {accept}\r\n\r\n"
+            ).encode()
+        )
+        await writer.drain()
+        log(f"ws {peer}: connected")
+
+        ws = WebSocket(reader, writer)
+        heartbeats = asyncio.ensure_future(self.heartbeats(ws))
+        # Push tasks of this connection, by subscription ID; a resubscribe
+        # replaces the earlier subscription
+        push_tasks = {}
+        try:
+            while True:
+                message = await ws.receive()
+                if message is None:
+                    break
+                try:
+                    event = json.loads(message)
+                except ValueError:
+                    log(f"ws {peer}: unparseable message: {message[:80]}")
+                    continue
+                if event.get("event") == "schedule:subscribe":
+                    data = event.get("data", {})
+                    subscription_id = data.get("subscriptionId")
+                    log(f"ws {peer}: subscribe {json.dumps(data)}")
+                    previous = push_tasks.pop(subscription_id, None)
+                    if previous is not None:
+                        previous.cancel()
+                    push_tasks[subscription_id] = asyncio.ensure_future(
+                        self.push_schedules(ws, subscription_id, peer)
+                    )
+        finally:
+            heartbeats.cancel()
+            for task in push_tasks.values():
+                task.cancel()
+            log(f"ws {peer}: closed")
+
+    async def heartbeats(self, ws):
+        sent = 0
+        while self.args.heartbeat > 0:
+            await asyncio.sleep(self.args.heartbeat)
+            if self.args.stall_heartbeats_after and sent >= self.args.stall_heartbeats_after:
+                continue  # Connection stays open but goes quiet
+            await ws.send(json.dumps({"event": "heartbeat", "data": None}))
+            sent += 1
+
+    async def push_schedules(self, ws, subscription_id, peer):
+        while True:
+            self.sequence += 1
+            sequence = self.sequence
+            await asyncio.sleep(random.uniform(0, self.args.jitter))
+
+            if random.random() < self.args.drop_rate:
+                log(f"ws {peer}: injected disconnect before push #{sequence}")
+                ws.writer.close()
+                return
+
+            frame = build_schedule(self.args, subscription_id, sequence)
+            if random.random() < self.args.malformed_rate:
+                frame = frame[: len(frame) // 2]
+                log(f"ws {peer}: injected malformed push #{sequence}")
+
+            start = time.monotonic()
+            await ws.send(frame)
+            log(
+                f"ws {peer}: push #{sequence} sub={subscription_id} {len(frame)} bytes, "
+                f"{self.args.trips} trips, sent in {(time.monotonic() - start) * 1000:.1f}ms"
+            )
+            await asyncio.sleep(self.args.interval)
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--mac", default="AA:BB:CC:DD:EE:FF", help="device MAC address the config entry is keyed by")
+    parser.add_argument("--stops", default="stop_0", type=lambda value: value.split(","), help="comma-separated stop IDs")
+    parser.add_argument("--routes", type=int, default=3, help="routes per stop")
+    parser.add_argument("--timetable", action="store_true", help="include per-stop offline timetables in the config")
+    parser.add_argument(
+        "--rotate-config", type=float, default=0,
+        help="change the config every this many seconds by rotating the stop order, 0 to keep it fixed",
+    )
+    parser.add_argument(
+        "--config-file", help="serve this file as the config, re-read on every request (overrides the generated one)"
+    )
+
+    payload = parser.add_argument_group("payload and rate")
+    payload.add_argument("--trips", type=int, default=20, help="trips per schedule frame")
+    payload.add_argument("--headsign-length", type=int, default=24)
+    payload.add_argument("--interval", type=float, default=30, help="seconds between schedule pushes")
+    payload.add_argument("--heartbeat", type=float, default=10, help="seconds between heartbeats, 0 for none")
+    payload.add_argument(
+        "--echo-subscription-id", action="store_true",
+        help="include subscriptionId in schedule frames (the public server does not)",
+    )
+
+    faults = parser.add_argument_group("fault injection")
+    faults.add_argument("--jitter", type=float, default=0, help="random extra delay before each push, seconds")
+    faults.add_argument("--drop-rate", type=float, default=0, help="chance of closing the connection before a push")
+    faults.add_argument("--malformed-rate", type=float, default=0, help="chance of sending a truncated frame")
+    faults.add_argument("--refuse-rate", type=float, default=0, help="chance of refusing a websocket connection")
+    faults.add_argument("--stall-heartbeats-after", type=int, default=0, help="stop heartbeats after this many")
+    faults.add_argument("--config-status", type=int, default=200, help="HTTP status for config requests")
+    faults.add_argument("--config-delay", type=float, default=0, help="seconds before answering config requests")
+    return parser.parse_args()
+
+
+async def main():
+    args = parse_args()
+    server = await asyncio.start_server(MockServer(args).handle, args.host, args.port)
+    log(f"Listening on {args.host}:{args.port} (ws://.../ and http://.../config.json)")
+    async with server:
+        await server.serve_forever()
+
+
+if __name__ == "__main__":
+    try:
+        asyncio.run(main())
+    except KeyboardInterrupt:
+        pass